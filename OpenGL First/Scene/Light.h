@@ -49,6 +49,8 @@ class Light
 	public:
 
 		Shader* lightShader;
+		//Light block read by the scene shaders and the light model
+		UniformBuffer* lightBuffer;
 
 		float scale;
 		glm::vec3 color;
@@ -56,6 +58,8 @@ class Light
 
 		unsigned int lightVBO;
 		unsigned int lightVAO;
+		//Changes whenever the light block does, so drawings lit by it can tell they are out of date
+		uint64_t version = 0;
 
 		Light(glm::vec3 pos, glm::vec3 col,float scaleMod, std::string vertShaderPath, std::string fragShaderPath)
 		{
@@ -63,13 +67,15 @@ class Light
 			color = col;
 			scale = scaleMod;
 			lightShader = new Shader(vertShaderPath.c_str(), fragShaderPath.c_str());
+			BindSharedUniformBlocks(lightShader);
+			lightBuffer = new UniformBuffer(LIGHT_BLOCK_BINDING, sizeof(LightBlock));
 
 			glGenVertexArrays(1, &lightVAO);
 			glGenBuffers(1, &lightVBO);
 
-			glBindVertexArray(lightVAO);
+			GLState.BindVertexArray(lightVAO);
 
-			glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+			GLState.BindBuffer(GL_ARRAY_BUFFER, lightVBO);
 			glBufferData(GL_ARRAY_BUFFER, sizeof(lightModelVertices), lightModelVertices, GL_STATIC_DRAW);
 
 			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -78,22 +84,30 @@ class Light
 		}
 
 
-		// Draws light model on a screen
-		void Draw(const glm::mat4 &view, const glm::mat4 &projection)
+		// Uploads position and color to the light block when they changed, before anything lit is drawn
+		void UpdateBlock()
+		{
+			LightBlock block;
+			block.position = position;
+			block.color = color;
+			if (lightBuffer->Upload(&block, 1))
+				version++;
+			lightBuffer->Bind(0);
+		}
+
+		// Draws light model on a screen with the view block of the current viewport
+		void Draw()
 		{
 			glm::mat4 model;
 			model = glm::translate(model, position);
 			model = glm::scale(model, glm::vec3(scale));
 
 			lightShader->use();
-			lightShader->setVec3("color", color);
-			lightShader->setMat4("model", model);
-			lightShader->setMat4("view", view);
-			lightShader->setMat4("projection", projection);
+			lightShader->setModel(model);
 
-			glBindVertexArray(lightVAO);
+			GLState.BindVertexArray(lightVAO);
 			glDrawArrays(GL_TRIANGLES, 0, 36);
-			glBindVertexArray(0);
+			RenderStats.drawCalls++;
 		}
 
 		~Light()
@@ -110,7 +124,13 @@ class Light
 				lightShader = NULL;
 			}
 
-			glDeleteBuffers(1, &lightVBO);
-			glDeleteVertexArrays(1, &lightVAO);
+			if (lightBuffer != NULL)
+			{
+				delete lightBuffer;
+				lightBuffer = NULL;
+			}
+
+			GLState.DeleteBuffer(lightVBO);
+			GLState.DeleteVertexArray(lightVAO);
 		}
 };
\ No newline at end of file
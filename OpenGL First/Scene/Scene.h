@@ -1,16 +1,52 @@
+#pragma once
+
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
 
 #include "utils/StringUtils.h"
 #include "utils/MatrixUtils.h"
+#include "utils/ParseUtils.h"
+#include "utils/MappedFile.h"
+#include "utils/ParallelUtils.h"
+#include "utils/NormalsUtils.h"
+#include "utils/BoundsUtils.h"
+#include "utils/RenderStats.h"
+#include "utils/VertexFormat.h"
+#include "utils/MeshOptimizer.h"
+#include "utils/MeshletUtils.h"
+#include "utils/MeshSimplifier.h"
+#include "utils/LodUtils.h"
+#include "utils/OcclusionCulling.h"
+#include "utils/Bvh.h"
+#include "utils/PickUtils.h"
+#include "utils/UniformBuffer.h"
+#include "utils/RenderList.h"
+#include "Scene/SceneCache.h"
 
 const unsigned int VERTEX_SIZE = 3;
+//Material of a part whose material name isn't in the scene, drawn with DefaultMaterial
+const unsigned int UNKNOWN_MATERIAL = (unsigned int)-1;
 const unsigned int INDEX_SIZE = 3;
 const float ORTHO_OFFSET = 0.5f;
+//Faces meeting at a sharper angle (in degrees) keep a hard edge when normals are generated
+const float NORMALS_CREASE_ANGLE = 60.0f;
 
 Material DefaultMaterial;
 float* DefaultColor;
 
+//Node of the .brp hierarchy (hier_name), its triangles are listed in Scene::nodes_triangles
+struct SceneNode
+{
+	std::string name;
+	unsigned int triangles_offset = 0;
+	unsigned int triangles_count = 0;
+	BoundingBox bounds;
+};
+
 class Scene
 {
 	
@@ -33,71 +69,267 @@ private:
 	const unsigned int Y = 1;
 	const unsigned int Z = 2;
 
-	float* vertices;
-	unsigned int vertices_count;
+	//Geometry arrays are read only once loaded, they may point into the mapped cache
+	const float* vertices = NULL;
+	unsigned int vertices_count = 0;
 
-	unsigned int* indices;
-	unsigned int indices_count;
+	const unsigned int* indices = NULL;
+	unsigned int indices_count = 0;
 
-	unsigned int* triangles_parts;
-	unsigned int triangles_count;
+	const unsigned int* triangles_parts = NULL;
+	unsigned int triangles_count = 0;
 
-	unsigned int* parts;
-	unsigned int parts_count;
+	const unsigned int* parts = NULL;
+	unsigned int parts_count = 0;
 
-	Material* materials;
-	unsigned int materials_count;
-	unsigned int** parts_indices;
-	unsigned int* triangles_parts_count;
+	Material* materials = NULL;
+	unsigned int materials_count = 0;
+	const unsigned int** parts_indices = NULL;
+	//All parts indices in one array with parts of the same material next to each other, parts_indices point into it
+	const unsigned int* parts_indices_buffer = NULL;
+	const unsigned int* triangles_parts_count = NULL;
 	std::vector<std::string> materials_names;
 
-	float* normals;
-	unsigned int normals_count;
+	const float* normals = NULL;
+	unsigned int normals_count = 0;
 
 	float minCoords[VERTEX_SIZE];
 	float maxCoords[VERTEX_SIZE];
 	float cameraCenter[VERTEX_SIZE];
 
-	std::stringstream sceneDataStream;
+	//Bounds computed once at load, so nothing else has to walk vertex data for them
+	BoundingBox bounds;
+	BoundingSphere boundingSphere;
+	const BoundingBox* parts_bounds = NULL;
+	std::vector<SceneNode> nodes;
+	std::vector<unsigned int> nodes_triangles;
+
 	unsigned int VBO, mainVAO, normalsBuffer;
-	unsigned int* EBO;
+	unsigned int EBO = 0;
+	size_t gpuMemoryUsage = 0;
+
+	//Uniform buffer with the materials block, see updateMaterialsBuffer
+	UniformBuffer* materials_buffer = NULL;
+	std::vector<MaterialBlockEntry> materials_entries;
+	//See GetContentVersion
+	uint64_t content_version = 1;
+
+	VertexFormat vertex_format = VERTEX_FORMAT_QUANTIZED_PACKED_NORMALS;
+	PositionQuantization position_quantization;
+	//Largest difference between uploaded and source positions, and between normals in degrees, 0 for float formats
+	float max_position_error = 0.0f;
+	float max_normal_error = 0.0f;
+	GLenum index_type = GL_UNSIGNED_INT;
+
+	//Face corners of a parsed .obj merged into the vertices, 0 for other scenes and scenes loaded from cache
+	unsigned int obj_welded_corners = 0;
+	//Faces of a parsed .obj left out for having fewer than 3 corners or a position out of range
+	unsigned int obj_skipped_faces = 0;
+
+	//Milliseconds the constructor took to parse the scene or load it from the .brpc cache
+	double load_time = 0.0;
+	bool loaded_from_cache = false;
+
+	//Triangles and vertices were reordered by optimizeMesh, cache stores the geometry in that order
+	bool mesh_optimized = false;
+	VertexCacheStatistics vertex_cache_statistics;
+	bool vertex_cache_analyzed = false;
+	//Statistics before optimizeMesh and milliseconds it took, optimize_time is 0 when it didn't run for this load
+	VertexCacheStatistics unoptimized_vertex_cache_statistics;
+	double optimize_time = 0.0;
+
+	//Mapped .brpc cache, geometry arrays point into it when scene was loaded from cache
+	MappedFile* cacheFile = NULL;
+
+	//Whole scene compiled for render_list_shader, compiled again when the shader or the GL buffers change
+	RenderList render_list;
+	Shader* render_list_shader = NULL;
+	bool render_list_dirty = true;
+	//First index of every part in the shared index buffer
+	std::vector<unsigned int> parts_offsets;
+	//Parts in the order of the shared index buffer
+	std::vector<unsigned int> parts_order;
+	//Vertex added to every index of the part, lets parts far apart in vertex array use 16-bit indices
+	std::vector<unsigned int> parts_base_vertices;
+
+	//Meshlets of all parts in index buffer order, culled per view by Draw(shader, view, projection)
+	const Meshlet* meshlets = NULL;
+	unsigned int meshlets_count = 0;
+	bool frustum_culling = true;
+	bool backface_culling = true;
+	CullingStatistics culling_statistics;
+	//Ranges of visible meshlets rebuilt every culled draw
+	RenderList culled_list;
+	//Visibility of every part (the whole scene when there are no parts) in the views of the last CullParts, bit per view
+	std::vector<uint8_t> parts_visibility;
+	//Views of the last CullParts, Draw with a view index uses them for culling and level of detail selection
+	std::vector<CullingView> culling_views;
+
+	//Levels of detail of every part (of the whole scene when there are no parts), simplified levels index the same
+	//vertices and follow the parts in the shared index buffer
+	const PartLods* parts_lods = NULL;
+	const unsigned int* lods_indices = NULL;
+	unsigned int lods_indices_count = 0;
+	//Milliseconds createLods took, 0 when levels were loaded from cache
+	double lods_time = 0.0;
+	bool lods_enabled = true;
+	float lod_pixel_error = DEFAULT_LOD_PIXEL_ERROR;
+
+	//Depth of the largest parts in every view of the last CullParts and parts hidden behind it, bit per view
+	bool occlusion_culling = true;
+	std::vector<OcclusionBuffer> occlusion_buffers;
+	std::vector<uint8_t> parts_occlusion;
+	std::vector<std::vector<std::pair<float, unsigned int>>> occluder_candidates;
+	double occlusion_time = 0.0;
+	//Views version and occlusion setting of the last CullParts
+	uint64_t culled_views_version = 0;
+	bool culled_occlusion = false;
+
+	//Built on first GetBvh, triangles in queries are numbered as in indices
+	Bvh* bvh = NULL;
 
 	//Obj file data
 	std::vector<glm::vec3> obj_vertices;
 	std::vector<glm::vec3> obj_normals;
+	std::vector<glm::vec2> obj_uvs;
 	std::vector<unsigned int> obj_normals_indices;
+	std::vector<unsigned int> obj_uvs_indices;
 	std::vector<unsigned int> obj_elements;
 
 public:
 
-	Scene(const char* scenePath)
+	Scene(const char* scenePath, VertexFormat format = VERTEX_FORMAT_QUANTIZED_PACKED_NORMALS, bool optimizeMeshOnLoad = false) : vertex_format(format), mesh_optimized(optimizeMeshOnLoad)
 	{
-		parseFromFile(scenePath);
-		findClippingCoords();
+		auto loadStart = std::chrono::high_resolution_clock::now();
+		loaded_from_cache = loadFromCache(scenePath);
+		if (!loaded_from_cache)
+		{
+			parseFromFile(scenePath);
+			if (normals == NULL && triangles_count > 0)
+				calculateNormals(NORMALS_CREASE_ANGLE);
+			if (parts_count > 0)
+				createMaterialsAndPartsIndices();
+			computeBounds();
+			if (mesh_optimized)
+				optimizeMesh();
+			createMeshlets();
+			createLods();
+			saveToCache(scenePath);
+		}
+		std::chrono::duration<double, std::milli> loadTime = std::chrono::high_resolution_clock::now() - loadStart;
+		load_time = loadTime.count();
+
 		initOpenglBuffors();
 
 		DefaultColor = new float[3]{ DefaultMaterial.color.r, DefaultMaterial.color.g, DefaultMaterial.color.b };
 	}
 
+	//Draws the whole scene from its render list, compiled on first use with a shader
 	void Draw(Shader* shader)
 	{
-		glBindVertexArray(mainVAO);
-		shader->setVec3("lightPos", LightPos);
-		shader->setVec3("lightColor", LightColor);
-		if (parts_count > 0)
+		if (render_list_dirty || render_list_shader != shader)
+			compileRenderList(shader);
+		executeRenderList(render_list);
+	}
+
+	//Tests bounds of every part against all views in one pass, then against the occluders of every view.
+	//The result is used by Draw with the view index. Views with the nonzero version of the last call are not culled again.
+	void CullParts(const CullingView* views, unsigned int viewsCount, uint64_t viewsVersion = 0)
+	{
+		if (viewsVersion != 0 && viewsVersion == culled_views_version && viewsCount == culling_views.size() && occlusion_culling == culled_occlusion)
+			return;
+		culled_views_version = viewsVersion;
+		culled_occlusion = occlusion_culling;
+
+		culling_views.assign(views, views + viewsCount);
+		parts_visibility.resize(parts_count > 0 ? parts_count : 1);
+		CullBoxes(FrustaPlanes(views, viewsCount), parts_count > 0 ? parts_bounds : &bounds, parts_visibility.size(), parts_visibility.data());
+
+		// Scenes smaller than the occluder budget draw faster on the GPU than they rasterize on the CPU
+		parts_occlusion.assign(parts_visibility.size(), 0);
+		occlusion_time = 0.0;
+		if (occlusion_culling && parts_count > 1 && triangles_count > OCCLUSION_TRIANGLE_BUDGET)
+			cullOccludedParts();
+	}
+
+	//Draws only meshlets that are inside the view frustum and not facing away from the view. With viewIndex of a view
+	//given to the last CullParts, meshlets of parts outside that view are skipped without testing them and parts
+	//are drawn at the coarsest level of detail within the pixel error budget of that view.
+	void Draw(Shader* shader, const glm::mat4& view, const glm::mat4& projection, int viewIndex = -1)
+	{
+		bool knownView = viewIndex >= 0 && viewIndex < (int)culling_views.size();
+		bool lods = lods_enabled && parts_lods != NULL && knownView;
+		bool occlusion = occlusion_culling && knownView;
+		if (meshlets_count == 0 || (!frustum_culling && !backface_culling && !lods && !occlusion))
+		{
+			culling_statistics = CullingStatistics();
+			culling_statistics.parts = culling_statistics.visibleParts = parts_count;
+			culling_statistics.meshlets = culling_statistics.visibleMeshlets = meshlets_count;
+			culling_statistics.triangles = culling_statistics.drawnTriangles = triangles_count;
+			Draw(shader);
+			return;
+		}
+
+		cullMeshlets(shader, knownView ? culling_views[viewIndex] : CullingView(view, projection), viewIndex, lods);
+		executeRenderList(culled_list);
+	}
+
+	//Draws the views of the last CullParts selected by the bits of viewsMask with one instanced submission, instance i
+	//for the i-th selected view, with a shader built with MULTI_VIEW that moves every instance into its viewport.
+	//Parts visible and not occluded in any of the views are drawn at full detail into all of them, meshlets are not
+	//culled and levels of detail are not used, since these depend on the view.
+	void DrawViews(Shader* shader, uint8_t viewsMask)
+	{
+		culling_statistics = CullingStatistics();
+		culling_statistics.parts = parts_count;
+		culling_statistics.meshlets = meshlets_count;
+		culling_statistics.triangles = triangles_count;
+		culled_list.Clear();
+
+		unsigned int viewsCount = 0;
+		unsigned int viewsEnd = 0;
+		for (unsigned int i = 0; i < MAX_CULLING_VIEWS; i++)
 		{
-			for (unsigned int i = 0; i < parts_count; ++i)
+			if (viewsMask & (1 << i))
 			{
-				shader->setMaterial(materials[parts[i]]);
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[i]);
-				glDrawElements(GL_TRIANGLES, triangles_parts_count[i] * INDEX_SIZE, GL_UNSIGNED_INT, (void*)0);			}
+				viewsCount++;
+				viewsEnd = i + 1;
+			}
 		}
-		else
+		if (viewsCount == 0)
+			return;
+
+		bool knownViews = !parts_visibility.empty() && viewsEnd <= culling_views.size();
+		bool partsOccluded = knownViews && parts_occlusion.size() == parts_visibility.size();
+		for (unsigned int i = 0; i < parts_order.size(); ++i)
+		{
+			unsigned int part = parts_order[i];
+			unsigned int partTriangles = triangles_parts_count[part];
+			uint8_t visibleViews = knownViews && frustum_culling ? parts_visibility[part] & viewsMask : viewsMask;
+			if (!visibleViews)
+			{
+				culling_statistics.frustumCulledTriangles += partTriangles;
+				continue;
+			}
+			if (partsOccluded && !(visibleViews & ~parts_occlusion[part]))
+			{
+				culling_statistics.occludedParts++;
+				culling_statistics.occlusionCulledTriangles += partTriangles;
+				continue;
+			}
+			if (partTriangles == 0)
+				continue;
+			culling_statistics.visibleParts++;
+			culling_statistics.drawnTriangles += partTriangles;
+			appendCulledRange(shader, parts[part], parts_offsets[part], partTriangles * INDEX_SIZE, parts_base_vertices[part]);
+		}
+		if (parts_count == 0)
 		{
-			shader->setMaterial(DefaultMaterial);
-			glDrawElements(GL_TRIANGLES, indices_count, GL_UNSIGNED_INT, (void*)0);
+			culling_statistics.drawnTriangles = triangles_count;
+			appendCulledRange(shader, materials_count, 0, indices_count, 0);
 		}
-		glBindVertexArray(0);
+
+		executeRenderList(culled_list, viewsCount);
 	}
 
 	float* GetMinCoords()
@@ -115,6 +347,295 @@ public:
 		return cameraCenter;
 	}
 
+	const BoundingBox& GetBounds()
+	{
+		return bounds;
+	}
+
+	const BoundingSphere& GetBoundingSphere()
+	{
+		return boundingSphere;
+	}
+
+	unsigned int GetPartsCount()
+	{
+		return parts_count;
+	}
+
+	const BoundingBox& GetPartBounds(unsigned int part)
+	{
+		return parts_bounds[part];
+	}
+
+	unsigned int GetNodesCount()
+	{
+		return nodes.size();
+	}
+
+	const SceneNode& GetNode(unsigned int node)
+	{
+		return nodes[node];
+	}
+
+	unsigned int GetMeshletsCount()
+	{
+		return meshlets_count;
+	}
+
+	//Simplified levels of all parts, the full detail levels not counted
+	unsigned int GetLodLevelsCount()
+	{
+		unsigned int levelsCount = 0;
+		unsigned int lodsParts = parts_count > 0 ? parts_count : 1;
+		for (unsigned int part = 0; parts_lods != NULL && part < lodsParts; part++)
+			levelsCount += parts_lods[part].count - 1;
+		return levelsCount;
+	}
+
+	unsigned int GetLodTrianglesCount()
+	{
+		return lods_indices_count / INDEX_SIZE;
+	}
+
+	//Milliseconds the levels took to simplify at this load, 0 when they were loaded from cache
+	double GetLodTime()
+	{
+		return lods_time;
+	}
+
+	//Changes whenever Draw would render a fixed view differently: new GL buffers, edited materials, culling or LOD settings.
+	//Edits of DefaultMaterial count once UpdateMaterials has uploaded them.
+	uint64_t GetContentVersion() const
+	{
+		return content_version;
+	}
+
+	//Uploads the materials block again when DefaultMaterial was edited, once per frame before drawing
+	void UpdateMaterials()
+	{
+		updateMaterialsBuffer();
+	}
+
+	//Statistics of the last Draw with view and projection
+	const CullingStatistics& GetCullingStatistics()
+	{
+		return culling_statistics;
+	}
+
+	bool IsFrustumCullingEnabled()
+	{
+		return frustum_culling;
+	}
+
+	void SetFrustumCulling(bool enabled)
+	{
+		frustum_culling = enabled;
+		content_version++;
+	}
+
+	bool IsBackfaceCullingEnabled()
+	{
+		return backface_culling;
+	}
+
+	void SetBackfaceCulling(bool enabled)
+	{
+		backface_culling = enabled;
+		content_version++;
+	}
+
+	bool IsLodEnabled()
+	{
+		return lods_enabled;
+	}
+
+	void SetLodEnabled(bool enabled)
+	{
+		lods_enabled = enabled;
+		content_version++;
+	}
+
+	//Largest projected simplification error in pixels a part may be drawn with
+	float GetLodPixelError()
+	{
+		return lod_pixel_error;
+	}
+
+	void SetLodPixelError(float pixelError)
+	{
+		lod_pixel_error = std::max(pixelError, 0.0f);
+		content_version++;
+	}
+
+	bool IsOcclusionCullingEnabled()
+	{
+		return occlusion_culling;
+	}
+
+	void SetOcclusionCulling(bool enabled)
+	{
+		occlusion_culling = enabled;
+		content_version++;
+	}
+
+	//Milliseconds the last CullParts spent drawing occluders and testing parts against them
+	double GetOcclusionTime()
+	{
+		return occlusion_time;
+	}
+
+	//Milliseconds spent parsing the scene file, or loading the .brpc cache when IsLoadedFromCache
+	double GetLoadTime()
+	{
+		return load_time;
+	}
+
+	bool IsLoadedFromCache()
+	{
+		return loaded_from_cache;
+	}
+
+	//Face corners of a parsed .obj welded into GetVerticesCount vertices, 0 when no .obj was welded
+	unsigned int GetObjWeldedCorners()
+	{
+		return obj_welded_corners;
+	}
+
+	unsigned int GetObjSkippedFaces()
+	{
+		return obj_skipped_faces;
+	}
+
+	//Largest position error of the vertex format relative to the largest scene extent
+	float GetRelativePositionError()
+	{
+		glm::vec3 extent = bounds.Size();
+		float sceneSize = glm::max(extent.x, glm::max(extent.y, extent.z));
+		return sceneSize > 0.0f ? max_position_error / sceneSize : 0.0f;
+	}
+
+	//Largest angle in degrees between a normal and its encoding in the vertex format
+	float GetNormalError()
+	{
+		return max_normal_error;
+	}
+
+	unsigned int GetVerticesCount()
+	{
+		return vertices_count / VERTEX_SIZE;
+	}
+
+	unsigned int GetTrianglesCount()
+	{
+		return triangles_count;
+	}
+
+	//Bytes uploaded to vertex and index buffers
+	size_t GetGpuMemoryUsage()
+	{
+		return gpuMemoryUsage;
+	}
+
+	bool IsMeshOptimized()
+	{
+		return mesh_optimized;
+	}
+
+	//Milliseconds optimizeMesh took when it ran at this load, 0 otherwise (not optimized, or loaded optimized from cache)
+	double GetOptimizeTime()
+	{
+		return optimize_time;
+	}
+
+	//ACMR and ATVR of the triangles in the order they were parsed, valid when GetOptimizeTime is nonzero
+	const VertexCacheStatistics& GetUnoptimizedVertexCacheStatistics()
+	{
+		return unoptimized_vertex_cache_statistics;
+	}
+
+	//ACMR and ATVR of the triangles in draw order, simulated once on first call
+	const VertexCacheStatistics& GetVertexCacheStatistics()
+	{
+		if (!vertex_cache_analyzed)
+		{
+			vertex_cache_statistics = AnalyzeVertexCache(parts_count > 0 ? parts_indices_buffer : indices, triangles_count * INDEX_SIZE);
+			vertex_cache_analyzed = true;
+		}
+		return vertex_cache_statistics;
+	}
+
+	//Hierarchy over all scene triangles, built in parallel on first call
+	const Bvh& GetBvh()
+	{
+		if (bvh == NULL)
+			bvh = new Bvh(vertices, indices, triangles_count);
+		return *bvh;
+	}
+
+	//Closest triangle along the ray, the hierarchy is built on first use
+	PickResult Pick(const BvhRay& ray)
+	{
+		PickResult result;
+		BvhHit hit;
+		if (triangles_count == 0 || !GetBvh().IntersectNearest(ray, hit))
+			return result;
+
+		result.hit = true;
+		result.triangle = hit.triangle;
+		result.distance = hit.distance;
+		result.position = ray.origin + ray.direction * hit.distance;
+		if (parts_count > 0)
+		{
+			result.part = triangles_parts[hit.triangle];
+			result.material = parts[result.part];
+		}
+
+		glm::vec3 positions[3];
+		GetTrianglePositions(hit.triangle, positions);
+		glm::vec3 normal = glm::cross(positions[1] - positions[0], positions[2] - positions[0]);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+			result.normal = (glm::dot(normal, ray.direction) > 0.0f ? -normal : normal) / length;
+		return result;
+	}
+
+	//Closest triangle under a point of the view given in normalized device coordinates
+	PickResult Pick(const glm::mat4& view, const glm::mat4& projection, const glm::vec2& ndc)
+	{
+		return Pick(UnprojectRay(ndc, view, projection));
+	}
+
+	//Vertices of a triangle numbered as in Pick
+	void GetTrianglePositions(unsigned int triangle, glm::vec3* positions)
+	{
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			const float* vertex = vertices + (size_t)indices[triangle * INDEX_SIZE + k] * VERTEX_SIZE;
+			positions[k] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+		}
+	}
+
+	std::string GetMaterialName(int material)
+	{
+		return material >= 0 && (unsigned int)material < materials_count ? materials[material].name : DefaultMaterial.name;
+	}
+
+	VertexFormat GetVertexFormat()
+	{
+		return vertex_format;
+	}
+
+	//Uploads the geometry again in another layout
+	void SetVertexFormat(VertexFormat format)
+	{
+		if (format == vertex_format)
+			return;
+
+		vertex_format = format;
+		disposeOpenglBuffors();
+		initOpenglBuffors();
+	}
+
 	glm::mat4 GetOrthoProjection(float ratio, Side side)
 	{
 		glm::mat2 ortho;
@@ -230,15 +751,40 @@ public:
 
 	void Dispose()
 	{
+		if (bvh != NULL)
+		{
+			delete bvh;
+			bvh = NULL;
+		}
+
+		if (cacheFile != NULL)
+		{
+			// Arrays living in the mapped cache are released together with the mapping
+			vertices = NULL;
+			normals = NULL;
+			indices = NULL;
+			triangles_parts = NULL;
+			triangles_parts_count = NULL;
+			parts = NULL;
+			parts_bounds = NULL;
+			parts_indices_buffer = NULL;
+			meshlets = NULL;
+			parts_lods = NULL;
+			lods_indices = NULL;
+
+			delete cacheFile;
+			cacheFile = NULL;
+		}
+
 		if (vertices != NULL)
 		{
-			delete vertices;
+			delete[] vertices;
 			vertices = NULL;
 		}
 
 		if (indices != NULL)
 		{
-			delete indices;
+			delete[] indices;
 			indices = NULL;
 		}
 
@@ -266,31 +812,50 @@ public:
 			materials = NULL;
 		}
 
-		if (parts_count != NULL)
+		if (parts_indices != NULL)
 		{
-			for (unsigned int i = 0; i < parts_count; i++)
-				delete parts_indices[i];
-
 			delete parts_indices;
 			parts_indices = NULL;
 		}
 
+		if (parts_indices_buffer != NULL)
+		{
+			delete[] parts_indices_buffer;
+			parts_indices_buffer = NULL;
+		}
+
 		if (normals != NULL)
 		{
-			delete normals;
+			delete[] normals;
+			normals = NULL;
+		}
+
+		if (parts_bounds != NULL)
+		{
+			delete[] parts_bounds;
+			parts_bounds = NULL;
+		}
+
+		if (meshlets != NULL)
+		{
+			delete[] meshlets;
+			meshlets = NULL;
 		}
 
-		glDeleteVertexArrays(1, &mainVAO);
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &normalsBuffer);
+		if (parts_lods != NULL)
+		{
+			delete[] parts_lods;
+			parts_lods = NULL;
+		}
 
-		if (EBO != NULL)
+		if (lods_indices != NULL)
 		{
-			glDeleteBuffers(parts_count, EBO);
-			delete EBO;
-			EBO = NULL;
+			delete[] lods_indices;
+			lods_indices = NULL;
 		}
 
+		disposeOpenglBuffors();
+
 		if (DefaultColor != NULL)
 		{
 			delete DefaultColor;
@@ -301,266 +866,1259 @@ public:
 
 private:
 	
-	//Finding clipping coords for scene
-	void findClippingCoords()
+	//Finding scene, parts and nodes bounds, scene box gives clipping coords
+	void computeBounds()
 	{
-		minCoords[0] = findMinVertexCoord(X);
-		minCoords[1] = findMinVertexCoord(Y);
-		minCoords[2] = findMinVertexCoord(Z);
-
-		maxCoords[0] = findMaxVertexCoord(X);
-		maxCoords[1] = findMaxVertexCoord(Y);
-		maxCoords[2] = findMaxVertexCoord(Z);
-
-		cameraCenter[0] = (minCoords[0] + maxCoords[0]) / 2.0f;
-		cameraCenter[1] = (minCoords[1] + maxCoords[2]) / 2.0f;
-		cameraCenter[2] = (minCoords[2] + maxCoords[2]) / 2.0f;
-	}
+		unsigned int verticesCount = vertices_count / VERTEX_SIZE;
+		bounds = ComputeBounds(vertices, verticesCount);
+		boundingSphere = ComputeBoundingSphere(vertices, verticesCount, bounds);
+		if (bounds.IsEmpty())
+			bounds = BoundingBox(glm::vec3(0.0f), glm::vec3(0.0f));
 
-	float findMinVertexCoord(unsigned int axis)
-	{
-		float min = vertices[axis];
-		for (int i = axis + VERTEX_SIZE; i < vertices_count; i += VERTEX_SIZE)
+		for (unsigned int i = 0; i < VERTEX_SIZE; i++)
 		{
-			if (vertices[i] < min)
-				min = vertices[i];
+			minCoords[i] = bounds.min[i];
+			maxCoords[i] = bounds.max[i];
+			cameraCenter[i] = bounds.Center()[i];
 		}
 
-		return min;
-	}
-
-	float findMaxVertexCoord(unsigned int axis)
-	{
-		float max = vertices[axis];
-		for (int i = axis + VERTEX_SIZE; i < vertices_count; i += VERTEX_SIZE)
+		if (parts_count > 0)
 		{
-			if (vertices[i] > max)
-				max = vertices[i];
+			BoundingBox* partsBounds = new BoundingBox[parts_count];
+			ParallelFor(parts_count, [&](unsigned int part)
+			{
+				partsBounds[part] = ComputeTrianglesBounds(vertices, parts_indices[part], NULL, triangles_parts_count[part]);
+			});
+			parts_bounds = partsBounds;
 		}
 
-		return max;
+		ParallelFor(nodes.size(), [&](unsigned int node)
+		{
+			nodes[node].bounds = ComputeTrianglesBounds(vertices, indices, nodes_triangles.data() + nodes[node].triangles_offset, nodes[node].triangles_count);
+		});
 	}
 
-	//Initialize opengl buffors and create parts and materials if available
+	//Initialize opengl buffors in the selected vertex format, the render list is compiled again on the next draw
 	void initOpenglBuffors()
 	{
-
-		glGenBuffers(1, &VBO);
 		glGenVertexArrays(1, &mainVAO);
+		GLState.BindVertexArray(mainVAO);
 
-		glBindVertexArray(mainVAO);
-
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices_count * sizeof(float), vertices, GL_STATIC_DRAW);
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
-
-		glGenBuffers(1, &normalsBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
-		glBufferData(GL_ARRAY_BUFFER, normals_count * sizeof(float), normals, GL_STATIC_DRAW);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
+		gpuMemoryUsage = 0;
+		uploadVertices();
 
+		// Element buffer binding is stored in the VAO, so drawing never rebinds it
+		glGenBuffers(1, &EBO);
+		GLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 		if (parts_count > 0)
-		{
-			createMaterialsAndPartsIndices();
+			uploadIndices(parts_indices_buffer, triangles_count * INDEX_SIZE);
+		else
+			uploadIndices(indices, indices_count);
 
-			EBO = new unsigned int[parts_count];
+		if (parts_count > 0)
+			createPartsOffsets();
+		updateMaterialsBuffer();
+		render_list_dirty = true;
+		content_version++;
+	}
 
-			glGenBuffers(parts_count, EBO);
-			for (unsigned int i = 0; i < parts_count; ++i)
-			{
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[i]);
-				glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles_parts_count[i] * INDEX_SIZE * sizeof(unsigned int), parts_indices[i], GL_STATIC_DRAW);
-			}
-		}
-		else
+	void disposeOpenglBuffors()
+	{
+		if (materials_buffer != NULL)
 		{
-			EBO = new unsigned int;
-			glGenBuffers(1, &EBO[0]);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[0]);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_count * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+			delete materials_buffer;
+			materials_buffer = NULL;
 		}
+		GLState.DeleteVertexArray(mainVAO);
+		GLState.DeleteBuffer(VBO);
+		GLState.DeleteBuffer(normalsBuffer);
+		GLState.DeleteBuffer(EBO);
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
+	glm::vec3 getNormal(unsigned int vertex)
+	{
+		if (normals == NULL || vertex * VERTEX_SIZE + 2 >= normals_count)
+			return glm::vec3(0.0f, 1.0f, 0.0f);
+		return glm::vec3(normals[vertex * VERTEX_SIZE], normals[vertex * VERTEX_SIZE + 1], normals[vertex * VERTEX_SIZE + 2]);
 	}
 
-	//Initialize materials and parts
-	void createMaterialsAndPartsIndices()
+	//Fills VBO (and normalsBuffer for separate layout) and points attributes 0 (position) and 1 (normal) at it
+	void uploadVertices()
 	{
-		unsigned int* temp_indices = new unsigned int[parts_count];
-		triangles_parts_count = new unsigned int[parts_count];
-		parts_indices = new unsigned int*[parts_count];
+		unsigned int verticesCount = vertices_count / VERTEX_SIZE;
+		position_quantization = PositionQuantization();
+		max_position_error = 0.0f;
+		max_normal_error = 0.0f;
+		glGenBuffers(1, &VBO);
+		GLState.BindBuffer(GL_ARRAY_BUFFER, VBO);
 
-		for (unsigned int i = 0; i < parts_count; ++i)
+		if (vertex_format == VERTEX_FORMAT_SEPARATE_FLOAT)
 		{
-			temp_indices[i] = 0;
-			triangles_parts_count[i] = 0;
+			glBufferData(GL_ARRAY_BUFFER, vertices_count * sizeof(float), vertices, GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(0);
+
+			glGenBuffers(1, &normalsBuffer);
+			GLState.BindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
+			glBufferData(GL_ARRAY_BUFFER, normals_count * sizeof(float), normals, GL_STATIC_DRAW);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(1);
+
+			gpuMemoryUsage += (vertices_count + normals_count) * sizeof(float);
+			return;
 		}
 
-		for (unsigned int i = 0; i < triangles_count; ++i)
-			triangles_parts_count[triangles_parts[i]] += 1;
+		if (vertex_format == VERTEX_FORMAT_INTERLEAVED_FLOAT)
+		{
+			std::vector<FloatVertex> interleaved(verticesCount);
+			for (unsigned int i = 0; i < verticesCount; i++)
+			{
+				glm::vec3 normal = getNormal(i);
+				for (unsigned int k = 0; k < VERTEX_SIZE; k++)
+				{
+					interleaved[i].position[k] = vertices[i * VERTEX_SIZE + k];
+					interleaved[i].normal[k] = normal[k];
+				}
+			}
 
-		for (unsigned int i = 0; i < parts_count; ++i)
-			parts_indices[i] = new unsigned int[triangles_parts_count[i] * INDEX_SIZE];
+			glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(FloatVertex), interleaved.data(), GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FloatVertex), (void*)offsetof(FloatVertex, position));
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(FloatVertex), (void*)offsetof(FloatVertex, normal));
+			glEnableVertexAttribArray(1);
 
+			gpuMemoryUsage += interleaved.size() * sizeof(FloatVertex);
+			return;
+		}
 
-		for (unsigned int i = 0; i < triangles_count; i++)
+		// Quantized formats, the shader restores positions with positionScale and positionOffset
+		position_quantization = PositionQuantization(bounds.min, bounds.max);
+		bool octahedral = vertex_format == VERTEX_FORMAT_QUANTIZED_OCTAHEDRAL_NORMALS;
+		std::vector<QuantizedVertex> quantized(verticesCount);
+		for (unsigned int i = 0; i < verticesCount; i++)
 		{
-			unsigned int part_index = triangles_parts[i];
-			parts_indices[part_index][temp_indices[part_index]] = indices[i * 3];
-			parts_indices[part_index][temp_indices[part_index] + 1] = indices[(i * 3) + 1];
-			parts_indices[part_index][temp_indices[part_index] + 2] = indices[(i * 3) + 2];
-			temp_indices[part_index] += 3;
+			for (unsigned int k = 0; k < VERTEX_SIZE; k++)
+			{
+				float position = vertices[i * VERTEX_SIZE + k];
+				quantized[i].position[k] = position_quantization.Quantize(position, k);
+				max_position_error = glm::max(max_position_error, glm::abs(position_quantization.Dequantize(quantized[i].position[k], k) - position));
+			}
+			quantized[i].position[3] = 0;
+
+			glm::vec3 normal = getNormal(i);
+			quantized[i].normal = octahedral ? PackNormalOctahedral(normal) : PackNormal2101010(normal);
+			glm::vec3 unpacked = octahedral ? UnpackNormalOctahedral(quantized[i].normal) : glm::normalize(UnpackNormal2101010(quantized[i].normal));
+			max_normal_error = glm::max(max_normal_error, glm::degrees(glm::acos(glm::clamp(glm::dot(unpacked, glm::normalize(normal)), -1.0f, 1.0f))));
 		}
 
-		delete temp_indices;
-	}
+		glBufferData(GL_ARRAY_BUFFER, quantized.size() * sizeof(QuantizedVertex), quantized.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, position));
+		glEnableVertexAttribArray(0);
+		if (octahedral)
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+		else
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+		glEnableVertexAttribArray(1);
 
-	//Loading scene from file (.brp or .obj)
-	//--------------------------------------------------------------------------------------------------
+		gpuMemoryUsage += quantized.size() * sizeof(QuantizedVertex);
+	}
 
-	//Load scene from file
-	void parseFromFile(std::string scenePathString)
+	//Uploads indices as 16-bit if the whole vertex array or every part (relative to its lowest vertex) fits, 32-bit otherwise.
+	//Simplified levels of detail follow the drawn indices.
+	void uploadIndices(const unsigned int* sourceIndices, unsigned int count)
 	{
-		if (scenePathString.substr(scenePathString.length() - 3, 3) == "obj")
+		unsigned int lodsCount = parts_lods != NULL ? lods_indices_count : 0;
+		const unsigned int SHORT_INDEX_LIMIT = 65536;
+		unsigned int verticesCount = vertices_count / VERTEX_SIZE;
+		index_type = GL_UNSIGNED_SHORT;
+		parts_base_vertices.assign(parts_count, 0);
+
+		if (verticesCount > SHORT_INDEX_LIMIT)
 		{
-			loadObj(scenePathString.c_str(), obj_vertices, obj_normals, obj_elements, obj_normals_indices);
-			vertices_count = obj_vertices.size() * VERTEX_SIZE;
-			vertices = new float[vertices_count];
-			int count = 0;
-			for (unsigned int i = 0; i < obj_vertices.size(); i++)
+			if (parts_count == 0)
+				index_type = GL_UNSIGNED_INT;
+
+			for (unsigned int i = 0; i < parts_count && index_type == GL_UNSIGNED_SHORT; i++)
 			{
-				vertices[i * 3] = obj_vertices[i].x;
-				vertices[i * 3 + 1] = obj_vertices[i].y;
-				vertices[i * 3 + 2] = obj_vertices[i].z;
-				if (vertices[i * 3] == 0 || vertices[i * 3 + 1] == 0 || vertices[i * 3 + 2] == 0)
-					count++;
+				unsigned int partIndicesCount = triangles_parts_count[i] * INDEX_SIZE;
+				if (partIndicesCount == 0)
+					continue;
+
+				unsigned int minVertex = *std::min_element(parts_indices[i], parts_indices[i] + partIndicesCount);
+				unsigned int maxVertex = *std::max_element(parts_indices[i], parts_indices[i] + partIndicesCount);
+				if (maxVertex - minVertex >= SHORT_INDEX_LIMIT)
+					index_type = GL_UNSIGNED_INT;
+				parts_base_vertices[i] = minVertex;
 			}
+		}
+
+		if (index_type == GL_UNSIGNED_INT)
+		{
+			parts_base_vertices.assign(parts_count, 0);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, (count + lodsCount) * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, count * sizeof(unsigned int), sourceIndices);
+			if (lodsCount > 0)
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(unsigned int), lodsCount * sizeof(unsigned int), lods_indices);
+			gpuMemoryUsage += (count + lodsCount) * sizeof(unsigned int);
+			return;
+		}
 
-			indices_count = obj_elements.size();
-			indices = new unsigned int[indices_count];
-			for (unsigned int i = 0; i < obj_elements.size(); i++)
+		std::vector<uint16_t> shortIndices(count + lodsCount);
+		if (parts_count > 0)
+		{
+			for (unsigned int i = 0; i < parts_count; i++)
 			{
-				indices[i] = obj_elements[i] - 1;
+				unsigned int first = parts_indices[i] - parts_indices_buffer;
+				for (unsigned int k = 0; k < triangles_parts_count[i] * INDEX_SIZE; k++)
+					shortIndices[first + k] = (uint16_t)(parts_indices_buffer[first + k] - parts_base_vertices[i]);
 			}
+		}
+		else
+		{
+			for (unsigned int i = 0; i < count; i++)
+				shortIndices[i] = (uint16_t)sourceIndices[i];
+		}
+
+		// Levels index only vertices of their part, so they fit relative to the same base vertex
+		unsigned int lodsParts = lodsCount > 0 ? std::max(parts_count, 1u) : 0;
+		for (unsigned int part = 0; part < lodsParts; part++)
+		{
+			GLint baseVertex = parts_count > 0 ? parts_base_vertices[part] : 0;
+			for (unsigned int level = 1; level < parts_lods[part].count; level++)
+			{
+				unsigned int first = parts_lods[part].indicesOffsets[level];
+				for (unsigned int k = 0; k < parts_lods[part].indicesCounts[level]; k++)
+					shortIndices[first + k] = (uint16_t)(lods_indices[first - count + k] - baseVertex);
+			}
+		}
+
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+		gpuMemoryUsage += shortIndices.size() * sizeof(uint16_t);
+	}
+
+	unsigned int indexSize()
+	{
+		return index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+	}
+
+	//Order of parts in the shared index buffer, grouped by material and by part number within it
+	std::vector<unsigned int> getPartsBufferOrder()
+	{
+		std::vector<unsigned int> order(parts_count);
+		for (unsigned int i = 0; i < parts_count; ++i)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return parts[a] < parts[b]; });
+		return order;
+	}
+
+	//First index of every part in the shared index buffer, in buffer order
+	void createPartsOffsets()
+	{
+		parts_offsets.resize(parts_count);
+		parts_order = getPartsBufferOrder();
+		for (unsigned int i = 0; i < parts_count; ++i)
+		{
+			unsigned int part = parts_order[i];
+			parts_offsets[part] = parts_indices[part] - parts_indices_buffer;
+		}
+	}
+
+	//One packet per part, sorted so parts of one material form one multi-draw. Ranges of consecutive parts with
+	//the same base vertex are merged into one packet.
+	void compileRenderList(Shader* shader)
+	{
+		render_list.Clear();
+		for (unsigned int i = 0; i < parts_order.size(); ++i)
+		{
+			unsigned int part = parts_order[i];
+			if (triangles_parts_count[part] > 0)
+				render_list.Add(createPacket(shader, parts[part], parts_offsets[part], triangles_parts_count[part] * INDEX_SIZE, parts_base_vertices[part]));
+		}
+		if (parts_count == 0)
+			render_list.Add(createPacket(shader, materials_count, 0, indices_count, 0));
+		render_list.Sort();
+		render_list_shader = shader;
+		render_list_dirty = false;
+	}
+
+	DrawPacket createPacket(Shader* shader, unsigned int material, unsigned int firstIndex, unsigned int count, GLint baseVertex)
+	{
+		DrawPacket packet;
+		packet.shader = shader;
+		packet.vao = mainVAO;
+		packet.material = material < materials_count ? material : materials_count;
+		packet.indexType = index_type;
+		packet.count = count;
+		packet.offset = (size_t)firstIndex * indexSize();
+		packet.baseVertex = baseVertex;
+		return packet;
+	}
+
+	//Program and material changes set the scene uniforms and point the shader at the material slot
+	void executeRenderList(RenderList& list, GLsizei instances = 1)
+	{
+		list.Execute([&](Shader* shader)
+		{
+			shader->use();
+			setDrawUniforms(shader);
+		}, [&](Shader* shader, unsigned int material)
+		{
+			setMaterial(shader, material);
+		}, instances);
+	}
+
+	void setDrawUniforms(Shader* shader)
+	{
+		shader->setVertexFormat(position_quantization.scale, position_quantization.offset, vertex_format == VERTEX_FORMAT_QUANTIZED_OCTAHEDRAL_NORMALS);
+	}
+
+	//Materials block holds scene materials followed by DefaultMaterial. Scene materials are fixed after loading,
+	//so the block is uploaded again only when DefaultMaterial is edited.
+	void updateMaterialsBuffer()
+	{
+		MaterialBlockEntry defaultMaterial(DefaultMaterial);
+		if (materials_buffer != NULL && std::memcmp(&materials_entries[materials_count], &defaultMaterial, sizeof(MaterialBlockEntry)) == 0)
+			return;
+		if (materials_buffer == NULL)
+			materials_buffer = new UniformBuffer(MATERIAL_BLOCK_BINDING, MATERIALS_PER_BLOCK * sizeof(MaterialBlockEntry));
+
+		unsigned int windows = materials_count / MATERIALS_PER_BLOCK + 1;
+		materials_entries.resize(windows * MATERIALS_PER_BLOCK);
+		for (unsigned int i = 0; i < materials_count; i++)
+			materials_entries[i] = MaterialBlockEntry(materials[i]);
+		materials_entries[materials_count] = defaultMaterial;
+		materials_buffer->Upload(materials_entries.data(), windows);
+		content_version++;
+	}
+
+	//Binds the window of the materials block holding the material slot and points the shader at it
+	void setMaterial(Shader* shader, unsigned int material)
+	{
+		materials_buffer->Bind(material / MATERIALS_PER_BLOCK);
+		shader->setMaterialIndex(material % MATERIALS_PER_BLOCK);
+	}
 
-			std::vector<float> populated_vertices;
-			std::vector<float> populated_normals;
-			for (unsigned int i = 0; i < indices_count; i++)
+	//Splits every part into meshlets, in index buffer order so meshlets of one material stay together
+	void createMeshlets()
+	{
+		const unsigned int* drawIndices = parts_count > 0 ? parts_indices_buffer : indices;
+		std::vector<std::vector<Meshlet>> partsMeshlets(parts_count > 0 ? parts_count : 1);
+		std::vector<unsigned int> order = getPartsBufferOrder();
+		ParallelFor(partsMeshlets.size(), [&](unsigned int i)
+		{
+			if (parts_count == 0)
 			{
-				populated_vertices.push_back(vertices[indices[i] * 3]);
-				populated_vertices.push_back(vertices[indices[i] * 3 + 1]);
-				populated_vertices.push_back(vertices[indices[i] * 3 + 2]);
-				populated_normals.push_back(obj_normals[obj_normals_indices[i] - 1].x);
-				populated_normals.push_back(obj_normals[obj_normals_indices[i] - 1].y);
-				populated_normals.push_back(obj_normals[obj_normals_indices[i] - 1].z);
-				indices[i] = i;
+				BuildMeshlets(partsMeshlets[i], indices, 0, triangles_count * INDEX_SIZE, 0, vertices);
+				return;
 			}
+			unsigned int part = order[i];
+			BuildMeshlets(partsMeshlets[i], drawIndices, parts_indices[part] - parts_indices_buffer, triangles_parts_count[part] * INDEX_SIZE, part, vertices);
+		});
 
-			delete vertices;
-			vertices_count = populated_vertices.size();
-			vertices = new float[vertices_count];
+		meshlets_count = 0;
+		for (unsigned int i = 0; i < partsMeshlets.size(); i++)
+			meshlets_count += partsMeshlets[i].size();
 
-			delete normals;
-			normals_count = populated_normals.size();
-			normals = new float[normals_count];
+		Meshlet* builtMeshlets = new Meshlet[meshlets_count];
+		Meshlet* meshlet = builtMeshlets;
+		for (unsigned int i = 0; i < partsMeshlets.size(); i++)
+		{
+			std::copy(partsMeshlets[i].begin(), partsMeshlets[i].end(), meshlet);
+			meshlet += partsMeshlets[i].size();
+		}
+		meshlets = builtMeshlets;
+	}
+
+	//Fills culled_list with index ranges of visible meshlets for the shader, in index buffer order so meshlets of one
+	//material stay together. Parts drawn at a simplified level add that level once in place of their meshlets,
+	//occluded parts add nothing.
+	void cullMeshlets(Shader* shader, const CullingView& view, int viewIndex, bool lods)
+	{
+		culling_statistics = CullingStatistics();
+		culling_statistics.parts = parts_count;
+		culling_statistics.meshlets = meshlets_count;
+		culling_statistics.triangles = triangles_count;
+		culled_list.Clear();
+
+		// Views CullParts didn't see have no part visibility or occlusion, only meshlets are culled for them
+		bool knownView = viewIndex >= 0 && viewIndex < (int)culling_views.size() && viewIndex < (int)MAX_CULLING_VIEWS && !parts_visibility.empty();
+		bool partsCulled = frustum_culling && knownView;
+		bool partsOccluded = knownView && parts_occlusion.size() == parts_visibility.size();
+		uint8_t viewBit = knownView ? (uint8_t)(1 << viewIndex) : 0;
+		for (unsigned int i = 0; i < parts_count; i++)
+		{
+			bool occluded = partsOccluded && (parts_occlusion[i] & viewBit) != 0;
+			culling_statistics.occludedParts += occluded ? 1 : 0;
+			culling_statistics.visibleParts += (!partsCulled || (parts_visibility[i] & viewBit)) && !occluded ? 1 : 0;
+		}
+		if (knownView && viewIndex < (int)occlusion_buffers.size() && occlusion_culling)
+			culling_statistics.occluderTriangles = occlusion_buffers[viewIndex].GetDrawnTriangles();
+
+		unsigned int lodPart = parts_count > 0 ? parts_count : 1;
+		unsigned int lodLevel = 0;
+		for (unsigned int i = 0; i < meshlets_count; i++)
+		{
+			const Meshlet& meshlet = meshlets[i];
+			unsigned int meshletTriangles = meshlet.indicesCount / INDEX_SIZE;
+			unsigned int part = parts_count > 0 ? meshlet.part : 0;
+			if (partsCulled && !(parts_visibility[part] & viewBit))
+			{
+				culling_statistics.frustumCulledTriangles += meshletTriangles;
+				continue;
+			}
+			if (partsOccluded && (parts_occlusion[part] & viewBit))
+			{
+				culling_statistics.occlusionCulledTriangles += meshletTriangles;
+				continue;
+			}
 
-			for (unsigned int i = 0; i < vertices_count; i++)
+			// Meshlets of a part are consecutive, its level is selected at the first one
+			if (lods && part != lodPart)
 			{
-				vertices[i] = populated_vertices[i];
+				lodPart = part;
+				const PartLods& partLods = parts_lods[part];
+				lodLevel = SelectLod(partLods, parts_count > 0 ? parts_bounds[part] : bounds, view, lod_pixel_error);
+				if (lodLevel > 0)
+				{
+					culling_statistics.lodParts++;
+					culling_statistics.drawnTriangles += partLods.indicesCounts[lodLevel] / INDEX_SIZE;
+					appendCulledRange(shader, parts_count > 0 ? parts[part] : materials_count, partLods.indicesOffsets[lodLevel], partLods.indicesCounts[lodLevel],
+						parts_count > 0 ? parts_base_vertices[part] : 0);
+				}
 			}
+			if (lods && lodLevel > 0)
+				continue;
 
-			for (unsigned int i = 0; i < normals_count; i++)
+			if (frustum_culling && !view.frustum.IntersectsSphere(meshlet.center, meshlet.radius))
+			{
+				culling_statistics.frustumCulledTriangles += meshletTriangles;
+				continue;
+			}
+			if (backface_culling && IsMeshletBackfacing(meshlet, view))
 			{
-				normals[i] = populated_normals[i];
+				culling_statistics.backfaceCulledTriangles += meshletTriangles;
+				continue;
 			}
+			culling_statistics.visibleMeshlets++;
+			culling_statistics.drawnTriangles += meshletTriangles;
+			appendCulledRange(shader, parts_count > 0 ? parts[meshlet.part] : materials_count, meshlet.indicesOffset, meshlet.indicesCount,
+				parts_count > 0 ? parts_base_vertices[meshlet.part] : 0);
+		}
+	}
+
+	//Draws the parts covering most pixels of each view into its occlusion buffer (through simplified levels when they
+	//are close enough), then marks parts inside a view frustum that are hidden behind that depth
+	void cullOccludedParts()
+	{
+		auto occlusionStart = std::chrono::high_resolution_clock::now();
+		unsigned int viewsCount = std::min((unsigned int)culling_views.size(), MAX_CULLING_VIEWS);
+		occlusion_buffers.resize(viewsCount);
+		occluder_candidates.resize(viewsCount);
+
+		ParallelFor(viewsCount, [&](unsigned int v)
+		{
+			const CullingView& view = culling_views[v];
+			uint8_t viewBit = (uint8_t)(1 << v);
+
+			// Parts by their size on screen, the ones around the camera first
+			std::vector<std::pair<float, unsigned int>>& candidates = occluder_candidates[v];
+			candidates.clear();
+			for (unsigned int part = 0; part < parts_count; part++)
+			{
+				if (!(parts_visibility[part] & viewBit) || parts_bounds[part].IsEmpty())
+					continue;
+				float pixels = GetPixelsPerUnit(parts_bounds[part], view, (float)OCCLUSION_HEIGHT);
+				pixels = pixels == FLT_MAX ? FLT_MAX : pixels * glm::length(parts_bounds[part].Size());
+				if (pixels >= OCCLUDER_MIN_PIXELS)
+					candidates.push_back(std::make_pair(pixels, part));
+			}
+			std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, unsigned int>>());
+
+			OcclusionBuffer& buffer = occlusion_buffers[v];
+			buffer.Begin(view.viewProjection);
+			unsigned int budget = OCCLUSION_TRIANGLE_BUDGET;
+			for (unsigned int i = 0; i < candidates.size() && budget > 0; i++)
+			{
+				unsigned int part = candidates[i].second;
+				unsigned int level = selectOccluderLevel(part, view, budget);
+				if (level == MAX_LODS)
+					continue;
+
+				unsigned int firstIndex = level == 0 ? parts_indices[part] - parts_indices_buffer : parts_lods[part].indicesOffsets[level];
+				unsigned int count = level == 0 ? triangles_parts_count[part] * INDEX_SIZE : parts_lods[part].indicesCounts[level];
+				const unsigned int* occluderIndices = level == 0 ? parts_indices_buffer + firstIndex : lods_indices + firstIndex - triangles_count * INDEX_SIZE;
+				buffer.DrawTriangles(vertices, occluderIndices, count);
+				budget -= count / INDEX_SIZE;
+			}
+			buffer.End();
+		});
+
+		ParallelFor((parts_count + OCCLUSION_CHUNK_SIZE - 1) / OCCLUSION_CHUNK_SIZE, [&](unsigned int chunk)
+		{
+			unsigned int last = std::min((chunk + 1) * OCCLUSION_CHUNK_SIZE, parts_count);
+			for (unsigned int part = chunk * OCCLUSION_CHUNK_SIZE; part < last; part++)
+			{
+				for (unsigned int v = 0; v < viewsCount; v++)
+				{
+					uint8_t viewBit = (uint8_t)(1 << v);
+					if ((parts_visibility[part] & viewBit) && occlusion_buffers[v].IsBoxOccluded(parts_bounds[part]))
+						parts_occlusion[part] |= viewBit;
+				}
+			}
+		});
+
+		occlusion_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - occlusionStart).count();
+	}
+
+	//Finest level of the part within the triangle budget whose error stays under a pixel of the occlusion buffer,
+	//MAX_LODS when no level qualifies
+	unsigned int selectOccluderLevel(unsigned int part, const CullingView& view, unsigned int budget)
+	{
+		unsigned int maxTriangles = std::min(budget, OCCLUDER_MAX_TRIANGLES);
+		if (parts_lods == NULL)
+			return triangles_parts_count[part] <= maxTriangles ? 0 : MAX_LODS;
+
+		const PartLods& partLods = parts_lods[part];
+		float pixelsPerUnit = GetPixelsPerUnit(parts_bounds[part], view, (float)OCCLUSION_HEIGHT);
+		for (unsigned int level = 0; level < partLods.count; level++)
+		{
+			if (level > 0 && partLods.errors[level] * pixelsPerUnit > OCCLUDER_PIXEL_ERROR)
+				break;
+			if (partLods.indicesCounts[level] / INDEX_SIZE <= maxTriangles)
+				return level;
+		}
+		return MAX_LODS;
+	}
+
+	//Appends range to the culled list, merged with the previous range when they touch and share the state
+	void appendCulledRange(Shader* shader, unsigned int material, unsigned int firstIndex, unsigned int count, GLint baseVertex)
+	{
+		culled_list.Add(createPacket(shader, material, firstIndex, count, baseVertex));
+	}
+
+	//Simplifies every part in parallel into a chain of levels, appended after the parts to the shared index buffer
+	void createLods()
+	{
+		auto lodsStart = std::chrono::high_resolution_clock::now();
+		unsigned int lodsParts = parts_count > 0 ? parts_count : 1;
+		std::vector<std::vector<SimplifiedLevel>> partsLevels(lodsParts);
+		ParallelFor(lodsParts, [&](unsigned int part)
+		{
+			const unsigned int* partIndices = parts_count > 0 ? parts_indices[part] : indices;
+			unsigned int partIndicesCount = (parts_count > 0 ? triangles_parts_count[part] : triangles_count) * INDEX_SIZE;
+			const BoundingBox& partBounds = parts_count > 0 ? parts_bounds[part] : bounds;
+			float maxError = partBounds.IsEmpty() ? 0.0f : glm::length(partBounds.Size()) * LOD_MAX_RELATIVE_ERROR;
+			SimplifyToLevels(partsLevels[part], partIndices, partIndicesCount, vertices, normals_count == vertices_count ? normals : NULL,
+				MAX_LODS - 1, LOD_REDUCTION, LOD_MIN_TRIANGLES, maxError);
+
+			if (mesh_optimized)
+			{
+				for (unsigned int level = 0; level < partsLevels[part].size(); level++)
+					OptimizeVertexCache(partsLevels[part][level].indices.data(), partsLevels[part][level].indices.size());
+			}
+		});
+
+		unsigned int drawIndicesCount = triangles_count * INDEX_SIZE;
+		lods_indices_count = 0;
+		for (unsigned int part = 0; part < lodsParts; part++)
+		{
+			for (unsigned int level = 0; level < partsLevels[part].size(); level++)
+				lods_indices_count += partsLevels[part][level].indices.size();
+		}
+
+		PartLods* partsLods = new PartLods[lodsParts];
+		unsigned int* lodsIndices = new unsigned int[lods_indices_count];
+		unsigned int lodsIndicesOffset = 0;
+		for (unsigned int part = 0; part < lodsParts; part++)
+		{
+			PartLods& partLods = partsLods[part];
+			memset(&partLods, 0, sizeof(PartLods));
+			partLods.count = partsLevels[part].size() + 1;
+			partLods.indicesOffsets[0] = parts_count > 0 ? parts_indices[part] - parts_indices_buffer : 0;
+			partLods.indicesCounts[0] = (parts_count > 0 ? triangles_parts_count[part] : triangles_count) * INDEX_SIZE;
+			for (unsigned int level = 1; level < partLods.count; level++)
+			{
+				const SimplifiedLevel& simplified = partsLevels[part][level - 1];
+				partLods.indicesOffsets[level] = drawIndicesCount + lodsIndicesOffset;
+				partLods.indicesCounts[level] = simplified.indices.size();
+				partLods.errors[level] = simplified.error;
+				std::copy(simplified.indices.begin(), simplified.indices.end(), lodsIndices + lodsIndicesOffset);
+				lodsIndicesOffset += simplified.indices.size();
+			}
+		}
+		parts_lods = partsLods;
+		lods_indices = lodsIndices;
+
+		std::chrono::duration<double, std::milli> lodsTime = std::chrono::high_resolution_clock::now() - lodsStart;
+		lods_time = lodsTime.count();
+	}
+
+	//Reorders triangles of every part for vertex cache and then for overdraw, vertices follow in order of first use.
+	//Original triangle order stays in indices for the hierarchy, only the drawn index buffer is reordered.
+	void optimizeMesh()
+	{
+		auto optimizeStart = std::chrono::high_resolution_clock::now();
+		const unsigned int* sourceIndices = parts_count > 0 ? parts_indices_buffer : indices;
+		unsigned int drawIndicesCount = triangles_count * INDEX_SIZE;
+		unoptimized_vertex_cache_statistics = AnalyzeVertexCache(sourceIndices, drawIndicesCount);
+
+		// Triangles are reordered in a new buffer that replaces the drawn one, like vertices below
+		unsigned int* drawIndices = new unsigned int[drawIndicesCount];
+		std::copy(sourceIndices, sourceIndices + drawIndicesCount, drawIndices);
+		ParallelFor(parts_count > 0 ? parts_count : 1, [&](unsigned int part)
+		{
+			unsigned int* partIndices = drawIndices + (parts_count > 0 ? parts_indices[part] - parts_indices_buffer : 0);
+			unsigned int partIndicesCount = (parts_count > 0 ? triangles_parts_count[part] : triangles_count) * INDEX_SIZE;
+			glm::vec3 center = parts_count > 0 ? parts_bounds[part].Center() : bounds.Center();
+
+			std::vector<unsigned int> clusters = OptimizeVertexCache(partIndices, partIndicesCount);
+			OptimizeOverdraw(partIndices, partIndicesCount, clusters, vertices, normals_count == vertices_count ? normals : NULL, center);
+		});
+
+		unsigned int verticesCount = vertices_count / VERTEX_SIZE;
+		std::vector<unsigned int> remap = OptimizeVertexFetch(drawIndices, drawIndicesCount, verticesCount);
+		if (remap.empty())
+		{
+			std::cout << "ERROR::SCENE::INDEX_OUT_OF_RANGE vertices were not reordered" << std::endl;
+		}
+		else
+		{
+			if (parts_count > 0)
+			{
+				unsigned int* remappedIndices = new unsigned int[indices_count];
+				for (unsigned int i = 0; i < indices_count; i++)
+					remappedIndices[i] = remap[indices[i]];
+				delete[] indices;
+				indices = remappedIndices;
+			}
+
+			float* remappedVertices = new float[vertices_count];
+			float* remappedNormals = normals_count == vertices_count ? new float[normals_count] : NULL;
+			for (unsigned int i = 0; i < verticesCount; i++)
+			{
+				for (unsigned int k = 0; k < VERTEX_SIZE; k++)
+				{
+					remappedVertices[remap[i] * VERTEX_SIZE + k] = vertices[i * VERTEX_SIZE + k];
+					if (remappedNormals != NULL)
+						remappedNormals[remap[i] * VERTEX_SIZE + k] = normals[i * VERTEX_SIZE + k];
+				}
+			}
+
+			delete[] vertices;
+			vertices = remappedVertices;
+			if (remappedNormals != NULL)
+			{
+				delete[] normals;
+				normals = remappedNormals;
+			}
+		}
+
+		if (parts_count > 0)
+		{
+			for (unsigned int part = 0; part < parts_count; part++)
+				parts_indices[part] = drawIndices + (parts_indices[part] - parts_indices_buffer);
+			delete[] parts_indices_buffer;
+			parts_indices_buffer = drawIndices;
+		}
+		else
+		{
+			delete[] indices;
+			indices = drawIndices;
+		}
+
+		vertex_cache_statistics = AnalyzeVertexCache(drawIndices, drawIndicesCount);
+		vertex_cache_analyzed = true;
+		std::chrono::duration<double, std::milli> optimizeTime = std::chrono::high_resolution_clock::now() - optimizeStart;
+		optimize_time = optimizeTime.count();
+	}
+
+	//Initialize materials and parts
+	void createMaterialsAndPartsIndices()
+	{
+		// Next free index of every part in the shared buffer
+		unsigned int* temp_indices = new unsigned int[parts_count];
+		unsigned int* partsTrianglesCount = new unsigned int[parts_count];
+		parts_indices = new const unsigned int*[parts_count];
+
+		for (unsigned int i = 0; i < parts_count; ++i)
+			partsTrianglesCount[i] = 0;
+
+		for (unsigned int i = 0; i < triangles_count; ++i)
+			partsTrianglesCount[triangles_parts[i]] += 1;
+
+		unsigned int* partsIndicesBuffer = new unsigned int[triangles_count * INDEX_SIZE];
+		std::vector<unsigned int> order = getPartsBufferOrder();
+		unsigned int partOffset = 0;
+		for (unsigned int i = 0; i < parts_count; ++i)
+		{
+			parts_indices[order[i]] = partsIndicesBuffer + partOffset;
+			temp_indices[order[i]] = partOffset;
+			partOffset += partsTrianglesCount[order[i]] * INDEX_SIZE;
+		}
+
+
+		for (unsigned int i = 0; i < triangles_count; i++)
+		{
+			unsigned int part_index = triangles_parts[i];
+			partsIndicesBuffer[temp_indices[part_index]] = indices[i * 3];
+			partsIndicesBuffer[temp_indices[part_index] + 1] = indices[(i * 3) + 1];
+			partsIndicesBuffer[temp_indices[part_index] + 2] = indices[(i * 3) + 2];
+			temp_indices[part_index] += 3;
+		}
+
+		triangles_parts_count = partsTrianglesCount;
+		parts_indices_buffer = partsIndicesBuffer;
+		delete temp_indices;
+	}
+
+	//Binary scene cache (.brpc)
+	//--------------------------------------------------------------------------------------------------
+
+	//Map scene cache and use its sections in place, fails when cache is missing or stale
+	bool loadFromCache(const std::string& scenePath)
+	{
+		bool cacheOnly = IsSceneCachePath(scenePath);
+		std::string cachePath = cacheOnly ? scenePath : GetSceneCachePath(scenePath);
+
+		MappedFile* cache = new MappedFile(cachePath.c_str());
+		if (!cache->IsOpen() || !IsSceneCacheValid(*(const SceneCacheHeader*)cache->Data(), cache->Size(), cacheOnly ? NULL : scenePath.c_str()))
+		{
+			delete cache;
+			return false;
+		}
+
+		// Cache made with the other optimization setting is parsed again (and overwritten) unless it's the only source
+		const SceneCacheHeader& header = *(const SceneCacheHeader*)cache->Data();
+		if (cacheOnly)
+			mesh_optimized = header.mesh_optimized != 0;
+		else if ((header.mesh_optimized != 0) != mesh_optimized)
+		{
+			delete cache;
+			return false;
+		}
+
+		const SceneCacheSection* sections = header.sections;
+		unsigned int partsIndicesCount = 0;
+		bool consistent =
+			sections[CACHE_VERTICES].size == header.vertices_count * sizeof(float) &&
+			sections[CACHE_NORMALS].size == header.normals_count * sizeof(float) &&
+			sections[CACHE_INDICES].size == header.indices_count * sizeof(unsigned int) &&
+			sections[CACHE_TRIANGLES_PARTS].size == (header.parts_count > 0 ? header.triangles_count * sizeof(unsigned int) : 0) &&
+			sections[CACHE_PARTS].size == header.parts_count * sizeof(unsigned int) &&
+			sections[CACHE_TRIANGLES_PARTS_COUNT].size == header.parts_count * sizeof(unsigned int) &&
+			sections[CACHE_MATERIALS].size == header.materials_count * sizeof(SceneCacheMaterial) &&
+			sections[CACHE_PARTS_BOUNDS].size == header.parts_count * sizeof(BoundingBox) &&
+			sections[CACHE_NODES].size == header.nodes_count * sizeof(SceneCacheNode) &&
+			sections[CACHE_MESHLETS].size % sizeof(Meshlet) == 0 &&
+			sections[CACHE_LODS].size == std::max(header.parts_count, 1u) * sizeof(PartLods) &&
+			sections[CACHE_LODS_INDICES].size % sizeof(unsigned int) == 0;
+
+		if (consistent)
+		{
+			const unsigned int* partsTriangles = (const unsigned int*)(cache->Data() + sections[CACHE_TRIANGLES_PARTS_COUNT].offset);
+			for (unsigned int i = 0; i < header.parts_count; i++)
+				partsIndicesCount += partsTriangles[i] * INDEX_SIZE;
+			consistent = sections[CACHE_PARTS_INDICES].size == partsIndicesCount * sizeof(unsigned int);
+		}
+
+		if (consistent)
+		{
+			const SceneCacheNode* cacheNodes = (const SceneCacheNode*)(cache->Data() + sections[CACHE_NODES].offset);
+			uint64_t nodesTrianglesCount = sections[CACHE_NODES_TRIANGLES].size / sizeof(unsigned int);
+			for (unsigned int i = 0; consistent && i < header.nodes_count; i++)
+				consistent = (uint64_t)cacheNodes[i].triangles_offset + cacheNodes[i].triangles_count <= nodesTrianglesCount;
+		}
+
+		if (consistent)
+		{
+			const Meshlet* cacheMeshlets = (const Meshlet*)(cache->Data() + sections[CACHE_MESHLETS].offset);
+			uint64_t cacheMeshletsCount = sections[CACHE_MESHLETS].size / sizeof(Meshlet);
+			uint64_t drawIndicesCount = (uint64_t)header.triangles_count * INDEX_SIZE;
+			for (uint64_t i = 0; consistent && i < cacheMeshletsCount; i++)
+			{
+				consistent = (uint64_t)cacheMeshlets[i].indicesOffset + cacheMeshlets[i].indicesCount <= drawIndicesCount &&
+					(cacheMeshlets[i].part < header.parts_count || cacheMeshlets[i].part == 0);
+			}
+		}
+
+		if (consistent)
+		{
+			const PartLods* cacheLods = (const PartLods*)(cache->Data() + sections[CACHE_LODS].offset);
+			uint64_t indicesEnd = (uint64_t)header.triangles_count * INDEX_SIZE + sections[CACHE_LODS_INDICES].size / sizeof(unsigned int);
+			for (unsigned int i = 0; consistent && i < std::max(header.parts_count, 1u); i++)
+			{
+				consistent = cacheLods[i].count >= 1 && cacheLods[i].count <= MAX_LODS;
+				for (unsigned int level = 0; consistent && level < cacheLods[i].count; level++)
+					consistent = (uint64_t)cacheLods[i].indicesOffsets[level] + cacheLods[i].indicesCounts[level] <= indicesEnd;
+			}
+		}
+
+		// Values are checked too, everything indexed with them trusts them afterwards
+		if (consistent)
+		{
+			const char* data = cache->Data();
+			uint64_t verticesCount = header.vertices_count / VERTEX_SIZE;
+			consistent = header.indices_count == (uint64_t)header.triangles_count * INDEX_SIZE &&
+				AreSectionValuesBelow(data, sections[CACHE_INDICES], verticesCount) &&
+				AreSectionValuesBelow(data, sections[CACHE_PARTS_INDICES], verticesCount) &&
+				AreSectionValuesBelow(data, sections[CACHE_LODS_INDICES], verticesCount) &&
+				AreSectionValuesBelow(data, sections[CACHE_TRIANGLES_PARTS], header.parts_count) &&
+				AreSectionValuesBelow(data, sections[CACHE_NODES_TRIANGLES], header.triangles_count);
+
+			const unsigned int* partsMaterials = (const unsigned int*)(data + sections[CACHE_PARTS].offset);
+			for (unsigned int i = 0; consistent && i < header.parts_count; i++)
+				consistent = partsMaterials[i] < header.materials_count || partsMaterials[i] == UNKNOWN_MATERIAL;
+		}
+
+		if (!consistent)
+		{
+			std::cout << "ERROR::SCENE::CACHE_CORRUPTED " << cachePath << std::endl;
+			delete cache;
+			return false;
+		}
+
+		cacheFile = cache;
+		// Sections are used in place, the mapping is read only
+		const char* data = cache->Data();
+
+		vertices_count = header.vertices_count;
+		normals_count = header.normals_count;
+		indices_count = header.indices_count;
+		triangles_count = header.triangles_count;
+		parts_count = header.parts_count;
+		materials_count = header.materials_count;
+
+		vertices = (const float*)(data + sections[CACHE_VERTICES].offset);
+		meshlets = (const Meshlet*)(data + sections[CACHE_MESHLETS].offset);
+		meshlets_count = sections[CACHE_MESHLETS].size / sizeof(Meshlet);
+		parts_lods = (const PartLods*)(data + sections[CACHE_LODS].offset);
+		lods_indices = (const unsigned int*)(data + sections[CACHE_LODS_INDICES].offset);
+		lods_indices_count = sections[CACHE_LODS_INDICES].size / sizeof(unsigned int);
+		normals = normals_count > 0 ? (const float*)(data + sections[CACHE_NORMALS].offset) : NULL;
+		indices = (const unsigned int*)(data + sections[CACHE_INDICES].offset);
+
+		for (unsigned int i = 0; i < VERTEX_SIZE; i++)
+		{
+			minCoords[i] = header.minCoords[i];
+			maxCoords[i] = header.maxCoords[i];
+			cameraCenter[i] = header.cameraCenter[i];
+		}
+		bounds = BoundingBox(glm::vec3(minCoords[0], minCoords[1], minCoords[2]), glm::vec3(maxCoords[0], maxCoords[1], maxCoords[2]));
+		boundingSphere.center = glm::vec3(header.sphereCenter[0], header.sphereCenter[1], header.sphereCenter[2]);
+		boundingSphere.radius = header.sphereRadius;
+
+		if (parts_count > 0)
+		{
+			triangles_parts = (const unsigned int*)(data + sections[CACHE_TRIANGLES_PARTS].offset);
+			parts = (const unsigned int*)(data + sections[CACHE_PARTS].offset);
+			triangles_parts_count = (const unsigned int*)(data + sections[CACHE_TRIANGLES_PARTS_COUNT].offset);
+			parts_bounds = (const BoundingBox*)(data + sections[CACHE_PARTS_BOUNDS].offset);
+
+			parts_indices_buffer = (const unsigned int*)(data + sections[CACHE_PARTS_INDICES].offset);
+			parts_indices = new const unsigned int*[parts_count];
+			std::vector<unsigned int> order = getPartsBufferOrder();
+			const unsigned int* partIndices = parts_indices_buffer;
+			for (unsigned int i = 0; i < parts_count; i++)
+			{
+				parts_indices[order[i]] = partIndices;
+				partIndices += triangles_parts_count[order[i]] * INDEX_SIZE;
+			}
+		}
+
+		if (materials_count > 0)
+		{
+			const SceneCacheMaterial* cacheMaterials = (const SceneCacheMaterial*)(data + sections[CACHE_MATERIALS].offset);
+			materials = new Material[materials_count];
+			for (unsigned int i = 0; i < materials_count; i++)
+			{
+				materials[i].name = std::string(cacheMaterials[i].name, strnlen(cacheMaterials[i].name, sizeof(cacheMaterials[i].name)));
+				materials[i].color = glm::vec3(cacheMaterials[i].color[0], cacheMaterials[i].color[1], cacheMaterials[i].color[2]);
+				materials[i].ambient = cacheMaterials[i].ambient;
+				materials[i].specular = cacheMaterials[i].specular;
+				materials_names.push_back(materials[i].name);
+			}
+		}
+
+		const SceneCacheNode* cacheNodes = (const SceneCacheNode*)(data + sections[CACHE_NODES].offset);
+		const unsigned int* nodesTriangles = (const unsigned int*)(data + sections[CACHE_NODES_TRIANGLES].offset);
+		nodes_triangles.assign(nodesTriangles, nodesTriangles + sections[CACHE_NODES_TRIANGLES].size / sizeof(unsigned int));
+		nodes.resize(header.nodes_count);
+		for (unsigned int i = 0; i < header.nodes_count; i++)
+		{
+			nodes[i].name = std::string(cacheNodes[i].name, strnlen(cacheNodes[i].name, sizeof(cacheNodes[i].name)));
+			nodes[i].triangles_offset = cacheNodes[i].triangles_offset;
+			nodes[i].triangles_count = cacheNodes[i].triangles_count;
+			nodes[i].bounds = BoundingBox(
+				glm::vec3(cacheNodes[i].minCoords[0], cacheNodes[i].minCoords[1], cacheNodes[i].minCoords[2]),
+				glm::vec3(cacheNodes[i].maxCoords[0], cacheNodes[i].maxCoords[1], cacheNodes[i].maxCoords[2]));
+		}
+
+		return true;
+	}
+
+	//Write parsed scene next to the source file so next load can skip parsing
+	void saveToCache(const std::string& scenePath)
+	{
+		if (IsSceneCachePath(scenePath) || vertices == NULL)
+			return;
+
+		SceneCacheWriter writer;
+		SceneCacheHeader& header = writer.header;
+
+		if (!GetFileStamp(scenePath.c_str(), header.sourceSize, header.sourceModificationTime))
+			return;
+		header.sourceHash = HashFile(scenePath.c_str());
+
+		header.vertices_count = vertices_count;
+		header.normals_count = normals != NULL ? normals_count : 0;
+		header.indices_count = indices_count;
+		header.triangles_count = triangles_count;
+		header.parts_count = parts_count;
+		header.materials_count = materials_count;
+		header.nodes_count = nodes.size();
+		header.mesh_optimized = mesh_optimized ? 1 : 0;
+
+		for (unsigned int i = 0; i < VERTEX_SIZE; i++)
+		{
+			header.minCoords[i] = minCoords[i];
+			header.maxCoords[i] = maxCoords[i];
+			header.cameraCenter[i] = cameraCenter[i];
+			header.sphereCenter[i] = boundingSphere.center[i];
+		}
+		header.sphereRadius = boundingSphere.radius;
+
+
+		std::vector<SceneCacheMaterial> cacheMaterials(materials_count);
+		for (unsigned int i = 0; i < materials_count; i++)
+		{
+			memset(&cacheMaterials[i], 0, sizeof(SceneCacheMaterial));
+			strncpy(cacheMaterials[i].name, materials[i].name.c_str(), sizeof(cacheMaterials[i].name) - 1);
+			cacheMaterials[i].color[0] = materials[i].color.r;
+			cacheMaterials[i].color[1] = materials[i].color.g;
+			cacheMaterials[i].color[2] = materials[i].color.b;
+			cacheMaterials[i].ambient = materials[i].ambient;
+			cacheMaterials[i].specular = materials[i].specular;
+		}
+
+		std::vector<SceneCacheNode> cacheNodes(nodes.size());
+		for (unsigned int i = 0; i < nodes.size(); i++)
+		{
+			memset(&cacheNodes[i], 0, sizeof(SceneCacheNode));
+			strncpy(cacheNodes[i].name, nodes[i].name.c_str(), sizeof(cacheNodes[i].name) - 1);
+			cacheNodes[i].triangles_offset = nodes[i].triangles_offset;
+			cacheNodes[i].triangles_count = nodes[i].triangles_count;
+			for (unsigned int k = 0; k < VERTEX_SIZE; k++)
+			{
+				cacheNodes[i].minCoords[k] = nodes[i].bounds.min[k];
+				cacheNodes[i].maxCoords[k] = nodes[i].bounds.max[k];
+			}
+		}
+
+		writer.SetSection(CACHE_VERTICES, vertices, vertices_count * sizeof(float));
+		writer.SetSection(CACHE_NORMALS, normals, header.normals_count * sizeof(float));
+		writer.SetSection(CACHE_INDICES, indices, indices_count * sizeof(unsigned int));
+		if (parts_count > 0)
+		{
+			writer.SetSection(CACHE_TRIANGLES_PARTS, triangles_parts, triangles_count * sizeof(unsigned int));
+			writer.SetSection(CACHE_PARTS, parts, parts_count * sizeof(unsigned int));
+			writer.SetSection(CACHE_TRIANGLES_PARTS_COUNT, triangles_parts_count, parts_count * sizeof(unsigned int));
+			writer.SetSection(CACHE_PARTS_INDICES, parts_indices_buffer, triangles_count * INDEX_SIZE * sizeof(unsigned int));
+			writer.SetSection(CACHE_PARTS_BOUNDS, parts_bounds, parts_count * sizeof(BoundingBox));
+		}
+		writer.SetSection(CACHE_MATERIALS, cacheMaterials.data(), cacheMaterials.size() * sizeof(SceneCacheMaterial));
+		writer.SetSection(CACHE_NODES, cacheNodes.data(), cacheNodes.size() * sizeof(SceneCacheNode));
+		writer.SetSection(CACHE_NODES_TRIANGLES, nodes_triangles.data(), nodes_triangles.size() * sizeof(unsigned int));
+		writer.SetSection(CACHE_MESHLETS, meshlets, meshlets_count * sizeof(Meshlet));
+		writer.SetSection(CACHE_LODS, parts_lods, std::max(parts_count, 1u) * sizeof(PartLods));
+		writer.SetSection(CACHE_LODS_INDICES, lods_indices, lods_indices_count * sizeof(unsigned int));
+
+		std::string cachePath = GetSceneCachePath(scenePath);
+		if (!writer.Write(cachePath))
+			std::cout << "ERROR::SCENE::CACHE_NOT_SUCCESFULLY_WRITTEN " << cachePath << std::endl;
+	}
+
+	//Loading scene from file (.brp or .obj)
+	//--------------------------------------------------------------------------------------------------
+
+	//Load scene from file
+	void parseFromFile(std::string scenePathString)
+	{
+		if (IsSceneCachePath(scenePathString))
+		{
+			std::cout << "ERROR::SCENE::CACHE_NOT_SUCCESFULLY_READ " << scenePathString << std::endl;
+		}
+		else if (scenePathString.substr(scenePathString.length() - 3, 3) == "obj")
+		{
+			loadObj(scenePathString.c_str(), obj_vertices, obj_normals, obj_uvs, obj_elements, obj_normals_indices, obj_uvs_indices);
+			weldObjVertices();
 		}
 		else
 		{
 			loadFile(scenePathString.c_str());
-			parseData();
 		}
 	}
 
-	//Loading .obj model from file
-	void loadObj(const char* filename, std::vector<glm::vec3> &vertices, std::vector<glm::vec3> &normals, std::vector<unsigned int> &elements, std::vector<unsigned int> &normals_indices)
+	//Builds indexed mesh from obj face corners, corners sharing both position and normal become one vertex.
+	//Corners without normal get the flat normal of their triangle, so they are never shared.
+	void weldObjVertices()
 	{
-		std::ifstream in(filename, std::ios::in);
-		if (!in)
+		indices_count = obj_elements.size();
+		triangles_count = indices_count / INDEX_SIZE;
+		unsigned int* weldedIndices = new unsigned int[indices_count];
+
+		// Corner that defines each unique vertex
+		std::vector<unsigned int> uniqueCorners;
+		uniqueCorners.reserve(obj_vertices.size());
+		std::unordered_map<uint64_t, unsigned int> weldedVertices;
+		weldedVertices.reserve(obj_vertices.size() * 2);
+
+		for (unsigned int i = 0; i < indices_count; i++)
+		{
+			if (obj_normals_indices[i] == 0)
+			{
+				weldedIndices[i] = uniqueCorners.size();
+				uniqueCorners.push_back(i);
+				continue;
+			}
+
+			uint64_t key = ((uint64_t)obj_elements[i] << 32) | obj_normals_indices[i];
+			auto inserted = weldedVertices.insert(std::make_pair(key, (unsigned int)uniqueCorners.size()));
+			if (inserted.second)
+				uniqueCorners.push_back(i);
+			weldedIndices[i] = inserted.first->second;
+		}
+
+		unsigned int uniqueCount = uniqueCorners.size();
+		vertices_count = uniqueCount * VERTEX_SIZE;
+		float* weldedPositions = new float[vertices_count];
+		normals_count = uniqueCount * VERTEX_SIZE;
+		float* weldedNormals = new float[normals_count];
+
+		for (unsigned int i = 0; i < uniqueCount; i++)
+		{
+			unsigned int corner = uniqueCorners[i];
+			glm::vec3 vertex = obj_vertices[obj_elements[corner] - 1];
+			weldedPositions[i * 3] = vertex.x;
+			weldedPositions[i * 3 + 1] = vertex.y;
+			weldedPositions[i * 3 + 2] = vertex.z;
+
+			glm::vec3 normal;
+			if (obj_normals_indices[corner] > 0)
+			{
+				normal = obj_normals[obj_normals_indices[corner] - 1];
+			}
+			else
+			{
+				unsigned int first = corner - corner % INDEX_SIZE;
+				glm::vec3 v0 = obj_vertices[obj_elements[first] - 1];
+				glm::vec3 v1 = obj_vertices[obj_elements[first + 1] - 1];
+				glm::vec3 v2 = obj_vertices[obj_elements[first + 2] - 1];
+				glm::vec3 faceNormal = glm::cross(v1 - v0, v2 - v0);
+				normal = glm::length(faceNormal) > 0.0f ? glm::normalize(faceNormal) : glm::vec3(0.0f, 1.0f, 0.0f);
+			}
+			weldedNormals[i * 3] = normal.x;
+			weldedNormals[i * 3 + 1] = normal.y;
+			weldedNormals[i * 3 + 2] = normal.z;
+		}
+
+		indices = weldedIndices;
+		vertices = weldedPositions;
+		normals = weldedNormals;
+		obj_welded_corners = indices_count;
+	}
+
+	//Loading .obj model from file, polygons of any size are fan triangulated.
+	//Indices are stored 1-based as in the file, negative (relative) ones resolved, 0 marks missing normal or uv.
+	void loadObj(const char* filename, std::vector<glm::vec3> &vertices, std::vector<glm::vec3> &normals, std::vector<glm::vec2> &uvs,
+		std::vector<unsigned int> &elements, std::vector<unsigned int> &normals_indices, std::vector<unsigned int> &uvs_indices)
+	{
+		MappedFile objFile(filename);
+		if (!objFile.IsOpen())
 		{
 			std::cerr << "Cannot open " << filename << std::endl;
+			return;
 		}
 
-		std::string line;
-		while (getline(in, line))
+		// Counting pass, so nothing is reallocated while parsing
+		size_t verticesCount = 0, normalsCount = 0, uvsCount = 0, cornersCount = 0;
+		const char* cursor = objFile.Data();
+		Token line, word;
+		while (NextLine(cursor, objFile.End(), line))
 		{
-			if (line.substr(0, 2) == "v ")
+			const char* lineCursor = line.begin;
+			if (!NextToken(lineCursor, line.end, word))
+				continue;
+
+			if (word.Equals("v", 1))
+				verticesCount++;
+			else if (word.Equals("vn", 2))
+				normalsCount++;
+			else if (word.Equals("vt", 2))
+				uvsCount++;
+			else if (word.Equals("f", 1))
 			{
-				std::vector<std::string> lines_v = Split(line.substr(2), " ");
-				glm::vec3 v;
-				v.x = stof(lines_v[0]);
-				v.y = stof(lines_v[1]);;
-				v.z = stof(lines_v[2]);;
-				vertices.push_back(v);
+				unsigned int faceCorners = 0;
+				while (NextToken(lineCursor, line.end, word))
+					faceCorners++;
+				if (faceCorners >= 3)
+					cornersCount += (faceCorners - 2) * INDEX_SIZE;
 			}
-			else if (line.substr(0, 3) == "vn ")
+		}
+
+		vertices.reserve(vertices.size() + verticesCount);
+		normals.reserve(normals.size() + normalsCount);
+		uvs.reserve(uvs.size() + uvsCount);
+		elements.reserve(elements.size() + cornersCount);
+		normals_indices.reserve(normals_indices.size() + cornersCount);
+		uvs_indices.reserve(uvs_indices.size() + cornersCount);
+
+		// Corners of the current face, reused by all faces
+		std::vector<unsigned int> facePositions, faceUvs, faceNormals;
+		unsigned int skippedFaces = 0;
+
+		cursor = objFile.Data();
+		while (NextLine(cursor, objFile.End(), line))
+		{
+			const char* lineCursor = line.begin;
+			if (!NextToken(lineCursor, line.end, word))
+				continue;
+
+			if (word.Equals("v", 1) || word.Equals("vn", 2))
 			{
-				std::vector<std::string> lines_v = Split(line.substr(3), " ");
+				bool isNormal = word.Equals("vn", 2);
 				glm::vec3 v;
-				v.x = stof(lines_v[0]);
-				v.y = stof(lines_v[1]);;
-				v.z = stof(lines_v[2]);;
-				normals.push_back(v);
+				for (unsigned int i = 0; i < 3; i++)
+					v[i] = NextToken(lineCursor, line.end, word) ? ParseFloat(word) : 0.0f;
+
+				if (isNormal)
+					normals.push_back(v);
+				else
+					vertices.push_back(v);
 			}
-			else if (line.substr(0, 2) == "f ")
+			else if (word.Equals("vt", 2))
 			{
-				std::vector<std::string> lines_f = Split(line.substr(2), " ");
-				for (unsigned int i = 0; i < 3; i++)
-				{
-					std::vector<std::string> lines_e = Split(lines_f[i], "/");
-					elements.push_back(std::stoi(lines_e[0]));
-					normals_indices.push_back(std::stoi(lines_e[2]));
-				}
-				if (lines_f.size() == 4)
+				glm::vec2 uv;
+				for (unsigned int i = 0; i < 2; i++)
+					uv[i] = NextToken(lineCursor, line.end, word) ? ParseFloat(word) : 0.0f;
+				uvs.push_back(uv);
+			}
+			else if (word.Equals("f", 1))
+			{
+				facePositions.clear();
+				faceUvs.clear();
+				faceNormals.clear();
+				bool validFace = true;
+				while (NextToken(lineCursor, line.end, word))
 				{
-					for (unsigned int i = 0; i < 4; i++)
+					int position = 0, uv = 0, normal = 0;
+					const char* c = word.begin;
+					ParseInt(c, word.end, position);
+					if (c < word.end && *c == '/')
 					{
-						if (i != 1)
+						c++;
+						ParseInt(c, word.end, uv);
+						if (c < word.end && *c == '/')
 						{
-							std::vector<std::string> lines_e = Split(lines_f[i], "/");
-							elements.push_back(std::stoi(lines_e[0]));
-							normals_indices.push_back(std::stoi(lines_e[2]));
+							c++;
+							ParseInt(c, word.end, normal);
 						}
 					}
+
+					facePositions.push_back(resolveObjIndex(position, vertices.size()));
+					faceUvs.push_back(resolveObjIndex(uv, uvs.size()));
+					faceNormals.push_back(resolveObjIndex(normal, normals.size()));
+					if (facePositions.back() == 0)
+						validFace = false;
 				}
 
-			}
-			else
-			{
-				/* ignoring this line */
-			}
+				unsigned int faceCorners = facePositions.size();
+
+				if (!validFace || faceCorners < 3)
+				{
+					skippedFaces++;
+					continue;
+				}
 
+				for (unsigned int i = 1; i + 1 < faceCorners; i++)
+				{
+					unsigned int corners[3] = { 0, i, i + 1 };
+					for (unsigned int k = 0; k < 3; k++)
+					{
+						elements.push_back(facePositions[corners[k]]);
+						uvs_indices.push_back(faceUvs[corners[k]]);
+						normals_indices.push_back(faceNormals[corners[k]]);
+					}
+				}
+			}
 		}
+
+		obj_skipped_faces = skippedFaces;
 	}
 
-	//Load file stream
-	void loadFile(const char* scenePath)
+	//Resolves 1-based or negative (relative to the end) obj index, returns 0 when it is missing or out of range
+	unsigned int resolveObjIndex(int index, size_t count)
 	{
-		std::ifstream sceneFile;
+		if (index > 0)
+			return (size_t)index <= count ? (unsigned int)index : 0;
+		if (index < 0)
+			return (size_t)(-(long long)index) <= count ? (unsigned int)(count + index + 1) : 0;
+		return 0;
+	}
 
-		sceneFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+	//Map scene file and parse it in place
+	void loadFile(const char* scenePath)
+	{
+		MappedFile sceneFile(scenePath);
+		if (!sceneFile.IsOpen())
 		{
-			sceneFile.open(scenePath);
-			sceneDataStream << sceneFile.rdbuf();
-			sceneFile.close();
+			std::cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			return;
 		}
-		catch (std::ifstream::failure e)
+
+		if (sceneFile.Size() >= PARALLEL_PARSE_MIN_SIZE && GetWorkerCount() > 1)
+			parseDataParallel(sceneFile.Data(), sceneFile.End(), GetWorkerCount());
+		else
+			parseData(sceneFile.Data(), sceneFile.End());
+
+		parseHierarchy(sceneFile.Data(), sceneFile.End());
+	}
+
+	//Parse hierarchy section, every hier_name starts a node and triangle_count lists its triangles
+	void parseHierarchy(const char* data, const char* dataEnd)
+	{
+		const char* cursor = FindWord(data, dataEnd, MESHES_INIT_HEADER);
+		if (cursor == NULL)
+			return;
+
+		Token word;
+		NextWord(cursor, dataEnd, word);
+		if (NextWord(cursor, dataEnd, word))
+			nodes.reserve(ParseUInt(word));
+
+		while (NextWord(cursor, dataEnd, word))
 		{
-			std::cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			if (word.Equals(MESH_NAME_HEADER))
+			{
+				SceneNode node;
+				if (NextWord(cursor, dataEnd, word))
+					node.name = word.ToString();
+				node.triangles_offset = nodes_triangles.size();
+				nodes.push_back(node);
+			}
+			else if (word.Equals(MESH_TRIANGLE_COUNT_HEADER) && !nodes.empty() && NextWord(cursor, dataEnd, word))
+			{
+				SceneNode& node = nodes.back();
+				unsigned int count = ParseUInt(word);
+				for (unsigned int i = 0; i < count && NextWord(cursor, dataEnd, word); i++)
+				{
+					unsigned int triangle = ParseUInt(word);
+					if (triangle < triangles_count)
+					{
+						nodes_triangles.push_back(triangle);
+						node.triangles_count++;
+					}
+				}
+			}
 		}
 	}
 
@@ -591,130 +2149,142 @@ private:
 	const unsigned int ASSIGN_MESH_TRIANGLES = 13;
 	const unsigned int LOAD_MESH_TRIANGLES = 14;
 
-	//Parse loaded file stream
-	void parseData()
+	//Parse mapped scene file, words are never copied out of the buffer.
+	//Parsing resumed after the parts section fills the parts array the caller allocated.
+	void parseData(const char* data, const char* dataEnd, unsigned int loadingState = 0, unsigned int index = 0, unsigned int* partsMaterials = NULL)
 	{
-		unsigned int loadingState = LOOK_FOR_VERTICES;
-		unsigned int index = 0;
-		std::string line;
-		while (std::getline(sceneDataStream, line)) {
-			std::vector<std::string> words = Split(line, " ");
-			for (unsigned int i = 0; i < words.size(); i++)
+		float* parsedVertices = NULL;
+		unsigned int* parsedIndices = NULL;
+		unsigned int* parsedTrianglesParts = NULL;
+		const char* cursor = data;
+		Token line;
+		while (NextLine(cursor, dataEnd, line)) {
+			LineTokenizer words(line);
+			Token word;
+			while (words.Next(word))
 			{
-				if (words[i].substr(0, 2) != "//")
+				if (word.StartsWith("//", 2))
+					continue;
+
+				bool reparseWord = true;
+				while (reparseWord)
 				{
+					reparseWord = false;
 					if (loadingState == LOOK_FOR_VERTICES)
 					{
-						if (words[i] == (VERTICES_HEADER))
+						if (word.Equals(VERTICES_HEADER))
 						{
-							loadingState = 1;
+							loadingState = ASSIGN_VERTICES_ARRAY;
 						}
 					}
 					else if (loadingState == ASSIGN_VERTICES_ARRAY)
 					{
-						vertices_count = std::stof(words[i]) * VERTEX_SIZE;
-						vertices = new float[vertices_count];
+						vertices_count = ParseUInt(word) * VERTEX_SIZE;
+						parsedVertices = new float[vertices_count];
+						vertices = parsedVertices;
 						loadingState = LOAD_VERTICES_ARRAY;
 						index = 0;
 					}
 					else if (loadingState == LOAD_VERTICES_ARRAY)
 					{
-						if (words[i] == (INDICES_HEADER))
+						if (word.Equals(INDICES_HEADER))
 						{
 							loadingState = ASSIGN_INDICES_ARRAY;
 						}
 						else if (index < vertices_count)
 						{
-							float element = std::stof(words[i]);
-							vertices[index] = element;
+							parsedVertices[index] = ParseFloat(word);
 							index++;
 						}
 					}
 					else if (loadingState == ASSIGN_INDICES_ARRAY)
 					{
-						triangles_count = std::stoul(words[i]);
+						triangles_count = ParseUInt(word);
 						indices_count = triangles_count * INDEX_SIZE;
-						indices = new unsigned int[indices_count];
+						parsedIndices = new unsigned int[indices_count];
+						indices = parsedIndices;
 						loadingState = LOAD_INDICES_ARRAY;
 						index = 0;
 					}
 					else if (loadingState == LOAD_INDICES_ARRAY)
 					{
-						if (words[i] == (PARTS_HEADER))
+						if (word.Equals(PARTS_HEADER))
 						{
 							loadingState = ASSIGN_PARTS_ARRAY;
 						}
 						else if (index < indices_count)
 						{
-							float element = std::stof(words[i]);
-							indices[index] = element;
+							parsedIndices[index] = ParseUInt(word);
 							index++;
 						}
 					}
 					else if (loadingState == ASSIGN_PARTS_ARRAY)
 					{
-						parts_count = std::stoul(words[i]);
-						parts = new unsigned int[parts_count];
-						triangles_parts = new unsigned int[triangles_count];
+						parts_count = ParseUInt(word);
+						partsMaterials = new unsigned int[parts_count];
+						parts = partsMaterials;
+						parsedTrianglesParts = new unsigned int[triangles_count];
+						triangles_parts = parsedTrianglesParts;
 						loadingState = LOAD_TRIANGLES_PARTS_ARRAY;
 						index = 0;
 					}
 					else if (loadingState == LOAD_TRIANGLES_PARTS_ARRAY)
 					{
-						if (words[i] == (MATERIALS_HEADER))
+						if (word.Equals(MATERIALS_HEADER))
 						{
 							loadingState = ASSIGN_MATERIALS_ARRAY;
 							index = 0;
 						}
 						else if (index < triangles_count)
 						{
-							float element = std::stoul(words[i]);
-							triangles_parts[index] = element;
+							parsedTrianglesParts[index] = ParseUInt(word);
 							index++;
 						}
 					}
 					else if (loadingState == ASSIGN_MATERIALS_ARRAY)
 					{
-						materials_count = std::stoul(words[i]);
+						materials_count = ParseUInt(word);
 						materials = new Material[materials_count];
 						loadingState = LOAD_MATERIALS_ARRAY;
 					}
 					else if (loadingState == LOAD_MATERIALS_ARRAY)
 					{
-						if (words[i] == MATERIAL_NAME_HEADER)
+						if (word.Equals(MATERIAL_NAME_HEADER))
 						{
-							materials[index].name = words[i + 1];
-							materials_names.push_back(words[i + 1]);
+							std::string name = words.Peek(1).ToString();
+							materials[index].name = name;
+							materials_names.push_back(name);
 						}
-						else if (words[i] == MATERIAL_COLOR_HEADER)
+						else if (word.Equals(MATERIAL_COLOR_HEADER))
 						{
-							materials[index].color = glm::vec3(std::stof(words[i + 1]), std::stof(words[i + 2]), std::stof(words[i + 3]));
+							materials[index].color = glm::vec3(ParseFloat(words.Peek(1)), ParseFloat(words.Peek(2)), ParseFloat(words.Peek(3)));
 							index++;
-							i += 3;
+							words.Skip(3);
 						}
-						if (index >= materials_count && words.size() == 2 && words[0] == "0")
+						if (index >= materials_count && words.Count() == 2 && words.First().Equals("0", 1))
 						{
 							loadingState = LOAD_PARTS_ARRAY;
 							index = 0;
-							i--;
+							reparseWord = true;
 						}
 					}
 					else if (loadingState == LOAD_PARTS_ARRAY)
 					{
-						if (index < parts_count && words.size() == 2)
+						if (index < parts_count && words.Count() == 2)
 						{
-							unsigned int name_ind = -1;
+							Token partMaterial = words.Peek(1);
+							unsigned int name_ind = UNKNOWN_MATERIAL;
 							for (unsigned int k = 0; k < materials_names.size(); k++)
 							{
-								if (materials_names[k] == words[i + 1])
+								if (partMaterial.Equals(materials_names[k]))
 								{
 									name_ind = k;
-									k = materials_names.size() + 1;
+									break;
 								}
 							}
-							parts[index] = name_ind;
+							partsMaterials[index] = name_ind;
 							index++;
-							i += 1;
+							words.Skip(1);
 						}
 					}
 				}
@@ -722,6 +2292,106 @@ private:
 		}
 	}
 
+	//Scene files of this size and bigger are parsed by all hardware threads
+	const size_t PARALLEL_PARSE_MIN_SIZE = 1 << 20;
+	const unsigned int PARSE_CHUNKS_PER_WORKER = 8;
+
+	//Parse scene file with numeric sections split between workers, gives the same result as parseData.
+	//Sections are found by a pre-scan for their headers, material and parts assignment tail is parsed sequentially.
+	void parseDataParallel(const char* data, const char* dataEnd, unsigned int workers)
+	{
+		const char* cursor = FindWord(data, dataEnd, VERTICES_HEADER);
+		Token countWord;
+		if (cursor == NULL || !nextSectionCount(cursor, dataEnd, VERTICES_HEADER, countWord))
+			return;
+
+		vertices_count = ParseUInt(countWord) * VERTEX_SIZE;
+		float* parsedVertices = new float[vertices_count];
+		vertices = parsedVertices;
+		const char* sectionEnd = FindWord(cursor, dataEnd, INDICES_HEADER);
+		parseSectionParallel(cursor, sectionEnd != NULL ? sectionEnd : dataEnd, parsedVertices, vertices_count, ParseFloat, workers);
+
+		cursor = sectionEnd;
+		if (cursor == NULL || !nextSectionCount(cursor, dataEnd, INDICES_HEADER, countWord))
+			return;
+
+		triangles_count = ParseUInt(countWord);
+		indices_count = triangles_count * INDEX_SIZE;
+		unsigned int* parsedIndices = new unsigned int[indices_count];
+		indices = parsedIndices;
+		sectionEnd = FindWord(cursor, dataEnd, PARTS_HEADER);
+		parseSectionParallel(cursor, sectionEnd != NULL ? sectionEnd : dataEnd, parsedIndices, indices_count, ParseUInt, workers);
+
+		cursor = sectionEnd;
+		if (cursor == NULL || !nextSectionCount(cursor, dataEnd, PARTS_HEADER, countWord))
+			return;
+
+		parts_count = ParseUInt(countWord);
+		unsigned int* partsMaterials = new unsigned int[parts_count];
+		parts = partsMaterials;
+		unsigned int* parsedTrianglesParts = new unsigned int[triangles_count];
+		triangles_parts = parsedTrianglesParts;
+		sectionEnd = FindWord(cursor, dataEnd, MATERIALS_HEADER);
+		parseSectionParallel(cursor, sectionEnd != NULL ? sectionEnd : dataEnd, parsedTrianglesParts, triangles_count, ParseUInt, workers);
+
+		// Rest of the line before materials header belonged to the parts section, so it starts as already full
+		if (sectionEnd != NULL)
+			parseData(FindLineStart(data, sectionEnd), dataEnd, LOAD_TRIANGLES_PARTS_ARRAY, triangles_count, partsMaterials);
+	}
+
+	//Moves cursor behind the section header and its count word, the way parseData states consume them
+	bool nextSectionCount(const char*& cursor, const char* dataEnd, const std::string& header, Token& countWord)
+	{
+		cursor += header.length();
+		while (NextWord(cursor, dataEnd, countWord))
+		{
+			if (!countWord.StartsWith("//", 2))
+				return true;
+		}
+		return false;
+	}
+
+	//Parses numeric section split into line aligned chunks. Words of every chunk are counted first
+	//so each worker knows at which array index its chunk starts.
+	template<typename T, typename Parser>
+	void parseSectionParallel(const char* sectionBegin, const char* sectionEnd, T* output, unsigned int outputCount, Parser parse, unsigned int workers)
+	{
+		std::vector<const char*> chunks = SplitAtLines(sectionBegin, sectionEnd, workers * PARSE_CHUNKS_PER_WORKER);
+		unsigned int chunksCount = (unsigned int)chunks.size() - 1;
+		std::vector<unsigned int> chunksStart(chunks.size(), 0);
+
+		ParallelFor(chunksCount, [&](unsigned int chunk)
+		{
+			const char* cursor = chunks[chunk];
+			unsigned int count = 0;
+			Token word;
+			while (NextWord(cursor, chunks[chunk + 1], word))
+			{
+				if (!word.StartsWith("//", 2))
+					count++;
+			}
+			chunksStart[chunk + 1] = count;
+		}, workers);
+
+		for (unsigned int i = 1; i < chunks.size(); i++)
+			chunksStart[i] += chunksStart[i - 1];
+
+		ParallelFor(chunksCount, [&](unsigned int chunk)
+		{
+			const char* cursor = chunks[chunk];
+			unsigned int index = chunksStart[chunk];
+			Token word;
+			while (index < outputCount && NextWord(cursor, chunks[chunk + 1], word))
+			{
+				if (!word.StartsWith("//", 2))
+				{
+					output[index] = parse(word);
+					index++;
+				}
+			}
+		}, workers);
+	}
+
 	//Optional operation on scene when object loaded
 	//-----------------------------------------------------------------------------------
 
@@ -730,115 +2400,58 @@ private:
 	{
 		std::cout << "Before " << vertices_count << " ";
 		std::vector<float> populated_vertices;
+		unsigned int* populated_indices = new unsigned int[indices_count];
 		for (unsigned int i = 0; i < indices_count; i++)
 		{
 			populated_vertices.push_back(vertices[indices[i] * 3]);
 			populated_vertices.push_back(vertices[indices[i] * 3 + 1]);
 			populated_vertices.push_back(vertices[indices[i] * 3 + 2]);
-			indices[i] = i;
+			populated_indices[i] = i;
 		}
 
-		delete vertices;
+		delete[] vertices;
+		delete[] indices;
+		indices = populated_indices;
 		vertices_count = populated_vertices.size();
 		std::cout << "after " << vertices_count << std::endl;
-		vertices = new float[vertices_count];
+		float* populatedVertices = new float[vertices_count];
 		for (unsigned int i = 0; i < vertices_count; i++)
 		{
-			vertices[i] = populated_vertices[i];
+			populatedVertices[i] = populated_vertices[i];
 		}
+		vertices = populatedVertices;
 	}
 
-	//Automatic calculating normals based on triangles
-	void calculateNormalsWithoutMeshes()
+	//Automatic calculating normals based on triangles, vertices on edges sharper than creaseAngle are split
+	void calculateNormals(float creaseAngle)
 	{
-		glm::vec3* triangles_normals = new glm::vec3[triangles_count];
-
-		glm::vec3 v[3];
-		glm::vec3 edge1, edge2;
-		glm::vec3 tempNormal;
+		MeshNormals meshNormals = CalculateNormals(vertices, vertices_count / VERTEX_SIZE, indices, triangles_count, creaseAngle);
 
-		for (unsigned int i = 0; i < triangles_count; i++)
+		if (!meshNormals.sourceVertices.empty())
 		{
-			for (unsigned int k = 0; k < 3; k++)
+			unsigned int splitCount = meshNormals.sourceVertices.size();
+			float* splitVertices = new float[splitCount * VERTEX_SIZE];
+			for (unsigned int i = 0; i < splitCount; i++)
 			{
-				v[k].x = vertices[indices[(i * 3) + k] * 3];
-				v[k].y = vertices[indices[(i * 3) + k] * 3 + 1];
-				v[k].z = vertices[indices[(i * 3) + k] * 3 + 2];
+				unsigned int source = meshNormals.sourceVertices[i];
+				splitVertices[i * VERTEX_SIZE] = vertices[source * VERTEX_SIZE];
+				splitVertices[i * VERTEX_SIZE + 1] = vertices[source * VERTEX_SIZE + 1];
+				splitVertices[i * VERTEX_SIZE + 2] = vertices[source * VERTEX_SIZE + 2];
 			}
 
-			edge1 = v[1] - v[0];
-			edge2 = v[2] - v[0];
-			tempNormal = glm::normalize(glm::cross(edge1, edge2));
-			triangles_normals[i] = tempNormal;
+			delete[] vertices;
+			vertices = splitVertices;
+			vertices_count = splitCount * VERTEX_SIZE;
+			unsigned int* splitIndices = new unsigned int[indices_count];
+			memcpy(splitIndices, meshNormals.indices.data(), indices_count * sizeof(unsigned int));
+			delete[] indices;
+			indices = splitIndices;
 		}
 
 		normals_count = vertices_count;
-		normals = new float[normals_count];
-
-		for (unsigned int i = 0; i < vertices_count / VERTEX_SIZE; i++)
-		{
-			tempNormal = glm::vec3(0);
-			for (unsigned int k = 0; k < indices_count / INDEX_SIZE; k++)
-			{
-				glm::vec3 v1;
-				glm::vec3 v2;
-				bool is_adjacent = false;
-
-				if (indices[3 * k] == i)
-				{
-					v1.x = vertices[indices[3 * k + 1] * 3];
-					v1.y = vertices[indices[3 * k + 1] * 3 + 1];
-					v1.z = vertices[indices[3 * k + 1] * 3 + 2];
-					v2.x = vertices[indices[3 * k + 2] * 3];
-					v2.y = vertices[indices[3 * k + 2] * 3 + 1];
-					v2.z = vertices[indices[3 * k + 2] * 3 + 2];
-					is_adjacent = true;
-				}
-				else if (indices[3 * k + 1] == i)
-				{
-					v1.x = vertices[indices[3 * k] * 3];
-					v1.y = vertices[indices[3 * k] * 3 + 1];
-					v1.z = vertices[indices[3 * k] * 3 + 2];
-					v2.x = vertices[indices[3 * k + 2] * 3];
-					v2.y = vertices[indices[3 * k + 2] * 3 + 1];
-					v2.z = vertices[indices[3 * k + 2] * 3 + 2];
-					is_adjacent = true;
-				}
-				else if (indices[3 * k + 2] == i)
-				{
-					v1.x = vertices[indices[3 * k] * 3];
-					v1.y = vertices[indices[3 * k] * 3 + 1];
-					v1.z = vertices[indices[3 * k] * 3 + 2];
-					v2.x = vertices[indices[3 * k + 1] * 3];
-					v2.y = vertices[indices[3 * k + 1] * 3 + 1];
-					v2.z = vertices[indices[3 * k + 1] * 3 + 2];
-					is_adjacent = true;
-				}
-
-				if (is_adjacent)
-				{
-					glm::vec3 v0;
-					v0.x = vertices[i * 3];
-					v0.y = vertices[i * 3 + 1];
-					v0.z = vertices[i * 3 + 2];
-
-					glm::vec3 e1 = v1 - v0;
-					glm::vec3 e2 = v2 - v0;
-					float weight = 1.0f;
-
-					if (glm::dot(e1, e2) >= 0)
-						weight = (glm::asin(glm::length(glm::cross(e1, e2)) / (glm::length(e1) * glm::length(e2))));
-					else
-						weight = (glm::pi<float>() - glm::asin(glm::length(glm::cross(e1, e2)) / (glm::length(e1) * glm::length(e2))));
-
-					tempNormal += weight * triangles_normals[k];
-				}
-			}
-			tempNormal = glm::normalize(tempNormal);
-			normals[i*VERTEX_SIZE] = tempNormal.x;
-			normals[i*VERTEX_SIZE + 1] = tempNormal.y;
-			normals[i*VERTEX_SIZE + 2] = tempNormal.z;
-		}
+		float* vertexNormals = new float[normals_count];
+		memcpy(vertexNormals, meshNormals.normals.data(), normals_count * sizeof(float));
+		normals = vertexNormals;
 	}
 
 	//-----------------------------------------------------------------------------------
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+
+#include "utils/MappedFile.h"
+
+//Binary scene cache (.brpc) written next to the source scene after the first load.
+//Every section starts at SCENE_CACHE_ALIGNMENT so the mapped file can be handed to glBufferData as it is.
+//--------------------------------------------------------------------------------------------------
+
+const char SCENE_CACHE_MAGIC[4] = { 'B', 'R', 'P', 'C' };
+const uint32_t SCENE_CACHE_VERSION = 8;
+const uint64_t SCENE_CACHE_ALIGNMENT = 64;
+const std::string SCENE_CACHE_EXTENSION = "brpc";
+
+enum SceneCacheSectionId
+{
+	CACHE_VERTICES,
+	CACHE_NORMALS,
+	CACHE_INDICES,
+	CACHE_TRIANGLES_PARTS,
+	CACHE_PARTS,
+	CACHE_TRIANGLES_PARTS_COUNT,
+	CACHE_PARTS_INDICES,
+	CACHE_MATERIALS,
+	CACHE_PARTS_BOUNDS,
+	CACHE_NODES,
+	CACHE_NODES_TRIANGLES,
+	CACHE_MESHLETS,
+	CACHE_LODS,
+	CACHE_LODS_INDICES,
+	CACHE_SECTIONS_COUNT
+};
+
+struct SceneCacheSection
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct SceneCacheMaterial
+{
+	char name[64];
+	float color[3];
+	float ambient;
+	float specular;
+};
+
+struct SceneCacheNode
+{
+	char name[64];
+	uint32_t triangles_offset;
+	uint32_t triangles_count;
+	float minCoords[3];
+	float maxCoords[3];
+};
+
+struct SceneCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+
+	uint32_t vertices_count;
+	uint32_t normals_count;
+	uint32_t indices_count;
+	uint32_t triangles_count;
+	uint32_t parts_count;
+	uint32_t materials_count;
+
+	float minCoords[3];
+	float maxCoords[3];
+	float cameraCenter[3];
+	uint32_t nodes_count;
+	float sphereCenter[3];
+	float sphereRadius;
+	uint32_t mesh_optimized;
+
+	SceneCacheSection sections[CACHE_SECTIONS_COUNT];
+};
+
+//Cache file path for given scene file (extension replaced with .brpc)
+inline std::string GetSceneCachePath(const std::string& scenePath)
+{
+	size_t dot = scenePath.find_last_of('.');
+	size_t slash = scenePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return scenePath + "." + SCENE_CACHE_EXTENSION;
+
+	return scenePath.substr(0, dot + 1) + SCENE_CACHE_EXTENSION;
+}
+
+inline bool IsSceneCachePath(const std::string& scenePath)
+{
+	return scenePath.length() > SCENE_CACHE_EXTENSION.length() &&
+		scenePath.compare(scenePath.length() - SCENE_CACHE_EXTENSION.length(), SCENE_CACHE_EXTENSION.length(), SCENE_CACHE_EXTENSION) == 0;
+}
+
+//Size and last modification time of a file
+inline bool GetFileStamp(const char* path, uint64_t& size, int64_t& modificationTime)
+{
+#ifdef _WIN32
+	struct _stat64 fileStat;
+	if (_stat64(path, &fileStat) != 0)
+		return false;
+#else
+	struct stat fileStat;
+	if (stat(path, &fileStat) != 0)
+		return false;
+#endif
+	size = (uint64_t)fileStat.st_size;
+	modificationTime = (int64_t)fileStat.st_mtime;
+	return true;
+}
+
+//64-bit FNV-1a over 8 byte words (and the remaining tail bytes)
+inline uint64_t HashBytes(const char* data, size_t size)
+{
+	const uint64_t FNV_PRIME = 1099511628211ull;
+	uint64_t hash = 14695981039346656037ull;
+
+	size_t words = size / sizeof(uint64_t);
+	for (size_t i = 0; i < words; i++)
+	{
+		uint64_t word;
+		memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+		hash = (hash ^ word) * FNV_PRIME;
+	}
+
+	for (size_t i = words * sizeof(uint64_t); i < size; i++)
+		hash = (hash ^ (unsigned char)data[i]) * FNV_PRIME;
+
+	return hash;
+}
+
+inline uint64_t HashFile(const char* path)
+{
+	MappedFile file(path);
+	return file.IsOpen() ? HashBytes(file.Data(), file.Size()) : 0;
+}
+
+//Checks that cache header belongs to the current version of the source file.
+//Matching size and modification time is trusted, otherwise source content hash decides.
+inline bool IsSceneCacheValid(const SceneCacheHeader& header, size_t cacheSize, const char* sourcePath)
+{
+	if (cacheSize < sizeof(SceneCacheHeader) || memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) != 0 || header.version != SCENE_CACHE_VERSION)
+		return false;
+
+	for (unsigned int i = 0; i < CACHE_SECTIONS_COUNT; i++)
+	{
+		if (header.sections[i].offset > cacheSize || header.sections[i].size > cacheSize - header.sections[i].offset)
+			return false;
+	}
+
+	if (sourcePath == NULL)
+		return true;
+
+	// A source that can't be checked can't prove the cache current, the scene is parsed instead
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+	if (!GetFileStamp(sourcePath, sourceSize, sourceModificationTime))
+		return false;
+
+	if (sourceSize != header.sourceSize)
+		return false;
+
+	if (sourceModificationTime == header.sourceModificationTime)
+		return true;
+
+	return HashFile(sourcePath) == header.sourceHash;
+}
+
+//True when every unsigned int of the section is below limit
+inline bool AreSectionValuesBelow(const char* cacheData, const SceneCacheSection& section, uint64_t limit)
+{
+	const unsigned int* values = (const unsigned int*)(cacheData + section.offset);
+	uint64_t count = section.size / sizeof(unsigned int);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (values[i] >= limit)
+			return false;
+	}
+	return true;
+}
+
+//Collects sections and writes them aligned after the header
+class SceneCacheWriter
+{
+public:
+
+	SceneCacheWriter()
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+		header.version = SCENE_CACHE_VERSION;
+	}
+
+	SceneCacheHeader header;
+
+	void SetSection(SceneCacheSectionId id, const void* data, uint64_t size)
+	{
+		sectionsData[id] = data;
+		header.sections[id].size = data != NULL ? size : 0;
+	}
+
+	bool Write(const std::string& cachePath)
+	{
+		uint64_t offset = alignOffset(sizeof(SceneCacheHeader));
+		for (unsigned int i = 0; i < CACHE_SECTIONS_COUNT; i++)
+		{
+			header.sections[i].offset = offset;
+			offset = alignOffset(offset + header.sections[i].size);
+		}
+
+		// Written under temporary name so a crash never leaves half written cache behind
+		std::string tempPath = cachePath + ".tmp";
+		std::ofstream cacheFile(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!cacheFile)
+			return false;
+
+		static const char padding[SCENE_CACHE_ALIGNMENT] = {};
+		uint64_t written = sizeof(SceneCacheHeader);
+		cacheFile.write((const char*)&header, sizeof(SceneCacheHeader));
+		for (unsigned int i = 0; i < CACHE_SECTIONS_COUNT; i++)
+		{
+			cacheFile.write(padding, (std::streamsize)(header.sections[i].offset - written));
+			if (header.sections[i].size > 0)
+				cacheFile.write((const char*)sectionsData[i], (std::streamsize)header.sections[i].size);
+			written = header.sections[i].offset + header.sections[i].size;
+		}
+		cacheFile.close();
+
+		if (!cacheFile)
+		{
+			std::remove(tempPath.c_str());
+			return false;
+		}
+
+		std::remove(cachePath.c_str());
+		return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+	}
+
+private:
+
+	const void* sectionsData[CACHE_SECTIONS_COUNT] = {};
+
+	static uint64_t alignOffset(uint64_t offset)
+	{
+		return (offset + SCENE_CACHE_ALIGNMENT - 1) & ~(SCENE_CACHE_ALIGNMENT - 1);
+	}
+};
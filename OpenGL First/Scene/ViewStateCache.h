@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Config/CameraConfig.h"
+#include "Utils/MatrixUtils.h"
+#include "utils/FrustumUtils.h"
+#include "Scene/Camera.h"
+#include "Scene/Scene.h"
+
+//How a viewport looks at the scene: through the camera, or orthographically from one side of the scene bounds
+struct ViewportSource
+{
+	bool perspective;
+	Scene::Side side;
+};
+
+//Matrices of one viewport. Version changes whenever any of them does, so consumers compare it instead of matrices.
+struct ViewportState
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::mat4 inverseViewProjection;
+	uint64_t version = 0;
+};
+
+//Owns view, projection, inverse and frustum planes of every viewport and the camera frustum outline drawn in the
+//orthographic ones. Update recomputes only viewports whose inputs (camera, zoom, window size, scene) changed.
+class ViewStateCache
+{
+public:
+	ViewStateCache(const ViewportSource* viewportSources, unsigned int count, float orthographicRatio) :
+		sources(viewportSources, viewportSources + count), states(count), cullingViews(count), orthoRatio(orthographicRatio)
+	{
+		for (unsigned int i = 0; i < 24; i++)
+			frustumVertices[i] = 0.0f;
+	}
+
+	//Brings every viewport up to date for this frame, returns true when any of them changed
+	bool Update(Camera& camera, Scene& scene, float aspectRatio, float viewportHeight)
+	{
+		glm::mat4 cameraView = camera.GetViewMatrix();
+		bool sizeChanged = invalid || aspectRatio != aspect || viewportHeight != viewportPixelsHeight;
+		bool cameraChanged = sizeChanged || cameraView != lastCameraView || camera.Zoom != zoom;
+		bool sceneChanged = sizeChanged || &scene != lastScene;
+		if (!cameraChanged && !sceneChanged)
+			return false;
+
+		invalid = false;
+		aspect = aspectRatio;
+		viewportPixelsHeight = viewportHeight;
+		lastCameraView = cameraView;
+		zoom = camera.Zoom;
+		lastScene = &scene;
+		version++;
+
+		for (unsigned int i = 0; i < sources.size(); i++)
+		{
+			if (sources[i].perspective ? !cameraChanged : !sceneChanged)
+				continue;
+
+			ViewportState& state = states[i];
+			if (sources[i].perspective)
+			{
+				state.view = cameraView;
+				state.projection = PerspectiveMatrix(glm::radians(zoom), aspect, NEAR_PLANE, FAR_PLANE);
+			}
+			else
+			{
+				state.view = scene.GetOrthoView(sources[i].side);
+				state.projection = scene.GetOrthoProjection(orthoRatio, sources[i].side);
+			}
+			state.viewProjection = state.projection * state.view;
+			state.inverseViewProjection = glm::inverse(state.viewProjection);
+			state.version = version;
+			cullingViews[i] = CullingView(state.view, state.projection, viewportPixelsHeight);
+		}
+
+		if (cameraChanged)
+			updateFrustumVertices(cameraView);
+		return true;
+	}
+
+	//Makes the next Update recompute everything, for changes its inputs don't show (a scene loaded at the address of the previous one)
+	void Invalidate()
+	{
+		invalid = true;
+	}
+
+	unsigned int GetViewportsCount() const
+	{
+		return states.size();
+	}
+
+	const ViewportState& GetViewport(unsigned int viewport) const
+	{
+		return states[viewport];
+	}
+
+	//Culling views of all viewports in order, with frustum planes, for Scene::CullParts
+	const CullingView* GetCullingViews() const
+	{
+		return cullingViews.data();
+	}
+
+	//Changes whenever any viewport does, 0 before the first Update
+	uint64_t GetVersion() const
+	{
+		return version;
+	}
+
+	//Corners of the camera frustum cut at FRUSTUM_FAR_PLANE, near plane first. They change with the camera,
+	//so together with the perspective viewports.
+	const float* GetFrustumVertices() const
+	{
+		return frustumVertices;
+	}
+
+private:
+	std::vector<ViewportSource> sources;
+	std::vector<ViewportState> states;
+	std::vector<CullingView> cullingViews;
+	float orthoRatio;
+	float frustumVertices[24];
+
+	// Inputs of the last Update
+	bool invalid = true;
+	glm::mat4 lastCameraView;
+	float zoom = 0.0f;
+	float aspect = 0.0f;
+	float viewportPixelsHeight = 0.0f;
+	const Scene* lastScene = NULL;
+	uint64_t version = 0;
+
+	void updateFrustumVertices(const glm::mat4& cameraView)
+	{
+		glm::mat4 projection = glm::perspective(glm::radians(zoom), aspect, NEAR_PLANE, FRUSTUM_FAR_PLANE);
+		glm::mat4 inverse = glm::inverse(projection * cameraView);
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			// Corners go around the near plane from the top left, then around the far plane
+			float x = (i % 4 == 1 || i % 4 == 2) ? 1.0f : -1.0f;
+			float y = (i % 4 < 2) ? 1.0f : -1.0f;
+			float z = i < 4 ? -1.0f : 1.0f;
+			glm::vec4 corner = inverse * glm::vec4(x, y, z, 1.0f);
+			corner /= corner.w;
+			for (unsigned int k = 0; k < 3; k++)
+				frustumVertices[i * 3 + k] = corner[k];
+		}
+	}
+};
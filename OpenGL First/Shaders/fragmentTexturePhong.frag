@@ -10,13 +10,45 @@ in vec3 Normal;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform Material mat;
+layout (std140) uniform ViewBlock
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+};
+
+layout (std140) uniform LightBlock
+{
+	vec3 lightPos;
+	vec3 lightColor;
+};
+
+//Materials of the scene, materialIndex selects the one of the drawn parts
+layout (std140) uniform MaterialBlock
+{
+	Material materials[256];
+};
+uniform int materialIndex;
+
+#ifdef MULTI_VIEW
+//Eye of the viewport the fragment is drawn into
+flat in vec3 EyePos;
+
+vec3 eyePosition()
+{
+	return EyePos;
+}
+#else
+vec3 eyePosition()
+{
+	return viewPos;
+}
+#endif
 
 void main()
 {
+	Material mat = materials[materialIndex];
+
 	// ambient
     float ambientStrength = mat.ambient;
     vec3 ambient = ambientStrength * lightColor;
@@ -29,7 +61,7 @@ void main()
 
 	// specular
     float specularStrength = mat.specular;
-    vec3 viewDir = normalize(viewPos - Pos);
+    vec3 viewDir = normalize(eyePosition() - Pos);
     vec3 reflectDir = reflect(-lightDir, norm);  
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     vec3 specular = specularStrength * spec * lightColor;
@@ -1,10 +1,13 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 transform;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform ViewBlock
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+};
 
 void main()
 {
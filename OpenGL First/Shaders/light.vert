@@ -2,14 +2,23 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 color;
+layout (std140) uniform ViewBlock
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+};
+
+layout (std140) uniform LightBlock
+{
+	vec3 lightPos;
+	vec3 lightColor;
+};
 
 out vec3 Color;
 
 void main()
 {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-	Color = color;
+	Color = lightColor;
 }
\ No newline at end of file
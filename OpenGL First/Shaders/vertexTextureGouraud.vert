@@ -13,19 +13,89 @@ out vec3 Color;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform Material mat;
+layout (std140) uniform ViewBlock
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+};
+
+layout (std140) uniform LightBlock
+{
+	vec3 lightPos;
+	vec3 lightColor;
+};
+
+//Materials of the scene, materialIndex selects the one of the drawn parts
+layout (std140) uniform MaterialBlock
+{
+	Material materials[256];
+};
+uniform int materialIndex;
+
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform bool octahedralNormals;
+
+#ifdef MULTI_VIEW
+//All viewports drawn in one instanced pass, instance i lands in viewport i of the window
+layout (std140) uniform ViewsBlock
+{
+	mat4 viewProjections[4];
+	//xy center of the viewport in window NDC, zw its size relative to the window
+	vec4 viewportTransforms[4];
+	//xyz eye every viewport is lit from, the viewPos of its ViewBlock
+	vec4 viewPositions[4];
+};
+
+//Clips to the view frustum of the instance, then squeezes the view into its viewport
+vec4 viewportPosition(vec4 worldPosition)
+{
+	vec4 clip = viewProjections[gl_InstanceID] * worldPosition;
+	gl_ClipDistance[0] = clip.w + clip.x;
+	gl_ClipDistance[1] = clip.w - clip.x;
+	gl_ClipDistance[2] = clip.w + clip.y;
+	gl_ClipDistance[3] = clip.w - clip.y;
+	vec4 viewport = viewportTransforms[gl_InstanceID];
+	return vec4(clip.xy * viewport.zw + viewport.xy * clip.w, clip.zw);
+}
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 viewPos;
+vec3 eyePosition()
+{
+	return viewPositions[gl_InstanceID].xyz;
+}
+#else
+vec4 viewportPosition(vec4 worldPosition)
+{
+	return projection * view * worldPosition;
+}
+
+vec3 eyePosition()
+{
+	return viewPos;
+}
+#endif
+
+//Octahedral normals come as 2 components, other formats already hold xyz
+vec3 decodeNormal(vec3 normal)
+{
+	if (!octahedralNormals)
+		return normal;
+
+	vec3 decoded = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+	if (decoded.z < 0.0)
+		decoded.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(decoded);
+}
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-	Pos = aPos;
-	Normal =  aNormal;
+	vec3 position = aPos * positionScale + positionOffset;
+    gl_Position = viewportPosition(model * vec4(position, 1.0));
+	Pos = position;
+	Normal = decodeNormal(aNormal);
+
+	Material mat = materials[materialIndex];
 
 	//Ambient
 	float ambientStrength = mat.ambient;
@@ -40,7 +110,7 @@ void main()
 
 	// specular
     float specularStrength = mat.specular;
-    vec3 viewDir = normalize(viewPos - Pos);
+    vec3 viewDir = normalize(eyePosition() - Pos);
     vec3 reflectDir = reflect(-lightDir, norm);  
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     vec3 specular = specularStrength * spec * lightColor;
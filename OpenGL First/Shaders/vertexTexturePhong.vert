@@ -7,12 +7,67 @@ out vec3 Pos;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform ViewBlock
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+};
+
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform bool octahedralNormals;
+
+#ifdef MULTI_VIEW
+//All viewports drawn in one instanced pass, instance i lands in viewport i of the window
+layout (std140) uniform ViewsBlock
+{
+	mat4 viewProjections[4];
+	//xy center of the viewport in window NDC, zw its size relative to the window
+	vec4 viewportTransforms[4];
+	//xyz eye every viewport is lit from, the viewPos of its ViewBlock
+	vec4 viewPositions[4];
+};
+//Eye of the viewport of the instance, the fragment shader lights from it
+flat out vec3 EyePos;
+
+//Clips to the view frustum of the instance, then squeezes the view into its viewport
+vec4 viewportPosition(vec4 worldPosition)
+{
+	vec4 clip = viewProjections[gl_InstanceID] * worldPosition;
+	gl_ClipDistance[0] = clip.w + clip.x;
+	gl_ClipDistance[1] = clip.w - clip.x;
+	gl_ClipDistance[2] = clip.w + clip.y;
+	gl_ClipDistance[3] = clip.w - clip.y;
+	vec4 viewport = viewportTransforms[gl_InstanceID];
+	return vec4(clip.xy * viewport.zw + viewport.xy * clip.w, clip.zw);
+}
+#else
+vec4 viewportPosition(vec4 worldPosition)
+{
+	return projection * view * worldPosition;
+}
+#endif
+
+//Octahedral normals come as 2 components, other formats already hold xyz
+vec3 decodeNormal(vec3 normal)
+{
+	if (!octahedralNormals)
+		return normal;
+
+	vec3 decoded = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+	if (decoded.z < 0.0)
+		decoded.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(decoded);
+}
 
 void main()
 {
-	Pos = vec3(model * vec4(aPos, 1));
-    gl_Position = projection * view * vec4(Pos, 1);
-	Normal = transpose(inverse(mat3(model))) * aNormal;
+	vec3 position = aPos * positionScale + positionOffset;
+	Pos = vec3(model * vec4(position, 1));
+    gl_Position = viewportPosition(vec4(Pos, 1));
+	Normal = transpose(inverse(mat3(model))) * decodeNormal(aNormal);
+#ifdef MULTI_VIEW
+	EyePos = viewPositions[gl_InstanceID].xyz;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "utils/ParallelUtils.h"
+
+//Axis aligned bounding box, empty until a point is added
+struct BoundingBox
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	BoundingBox() : min(FLT_MAX), max(-FLT_MAX) {}
+	BoundingBox(const glm::vec3& boxMin, const glm::vec3& boxMax) : min(boxMin), max(boxMax) {}
+
+	bool IsEmpty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	glm::vec3 Center() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	glm::vec3 Size() const
+	{
+		return max - min;
+	}
+
+	void Extend(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void Extend(const BoundingBox& box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;
+
+	BoundingSphere() : center(0.0f), radius(0.0f) {}
+};
+
+const unsigned int BOUNDS_CHUNK_SIZE = 65536;
+
+//Bounds of a tightly packed xyz vertex array. Four vertices (12 floats) are processed per step with
+//one min/max lane per float, so the inner loop is contiguous and vectorizes, lanes are folded per axis at the end.
+inline BoundingBox ComputeBounds(const float* vertices, unsigned int verticesCount, unsigned int workers = 0)
+{
+	const unsigned int LANES = 12;
+	unsigned int chunks = (verticesCount + BOUNDS_CHUNK_SIZE - 1) / BOUNDS_CHUNK_SIZE;
+	std::vector<BoundingBox> chunksBounds(chunks);
+
+	ParallelFor(chunks, [&](unsigned int chunk)
+	{
+		unsigned int first = chunk * BOUNDS_CHUNK_SIZE;
+		unsigned int last = std::min(first + BOUNDS_CHUNK_SIZE, verticesCount);
+		const float* data = vertices + (size_t)first * 3;
+		size_t floatsCount = (size_t)(last - first) * 3;
+
+		float minLanes[LANES], maxLanes[LANES];
+		for (unsigned int j = 0; j < LANES; j++)
+		{
+			minLanes[j] = FLT_MAX;
+			maxLanes[j] = -FLT_MAX;
+		}
+
+		size_t i = 0;
+		for (; i + LANES <= floatsCount; i += LANES)
+		{
+			for (unsigned int j = 0; j < LANES; j++)
+			{
+				float value = data[i + j];
+				minLanes[j] = value < minLanes[j] ? value : minLanes[j];
+				maxLanes[j] = value > maxLanes[j] ? value : maxLanes[j];
+			}
+		}
+		for (; i < floatsCount; i++)
+		{
+			minLanes[i % 3] = std::min(minLanes[i % 3], data[i]);
+			maxLanes[i % 3] = std::max(maxLanes[i % 3], data[i]);
+		}
+
+		BoundingBox bounds;
+		for (unsigned int j = 0; j < LANES; j++)
+		{
+			bounds.min[j % 3] = std::min(bounds.min[j % 3], minLanes[j]);
+			bounds.max[j % 3] = std::max(bounds.max[j % 3], maxLanes[j]);
+		}
+		chunksBounds[chunk] = bounds;
+	}, workers);
+
+	BoundingBox bounds;
+	for (unsigned int i = 0; i < chunks; i++)
+		bounds.Extend(chunksBounds[i]);
+	return bounds;
+}
+
+//Sphere around the box center with radius reaching the farthest vertex (tighter than the box diagonal)
+inline BoundingSphere ComputeBoundingSphere(const float* vertices, unsigned int verticesCount, const BoundingBox& bounds, unsigned int workers = 0)
+{
+	BoundingSphere sphere;
+	if (bounds.IsEmpty())
+		return sphere;
+
+	sphere.center = bounds.Center();
+	unsigned int chunks = (verticesCount + BOUNDS_CHUNK_SIZE - 1) / BOUNDS_CHUNK_SIZE;
+	std::vector<float> chunksRadius(chunks, 0.0f);
+
+	ParallelFor(chunks, [&](unsigned int chunk)
+	{
+		unsigned int last = std::min((chunk + 1) * BOUNDS_CHUNK_SIZE, verticesCount);
+		float maxDistance = 0.0f;
+		for (unsigned int i = chunk * BOUNDS_CHUNK_SIZE; i < last; i++)
+		{
+			float dx = vertices[i * 3] - sphere.center.x;
+			float dy = vertices[i * 3 + 1] - sphere.center.y;
+			float dz = vertices[i * 3 + 2] - sphere.center.z;
+			float distance = dx * dx + dy * dy + dz * dz;
+			maxDistance = distance > maxDistance ? distance : maxDistance;
+		}
+		chunksRadius[chunk] = maxDistance;
+	}, workers);
+
+	for (unsigned int i = 0; i < chunks; i++)
+		sphere.radius = std::max(sphere.radius, chunksRadius[i]);
+	sphere.radius = glm::sqrt(sphere.radius);
+	return sphere;
+}
+
+//Bounds of the triangles listed by index (triangle ids are optional, NULL means triangles 0..trianglesCount-1)
+inline BoundingBox ComputeTrianglesBounds(const float* vertices, const unsigned int* indices, const unsigned int* triangles, unsigned int trianglesCount)
+{
+	BoundingBox bounds;
+	for (unsigned int i = 0; i < trianglesCount; i++)
+	{
+		unsigned int triangle = triangles != NULL ? triangles[i] : i;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			const float* vertex = vertices + (size_t)indices[triangle * 3 + k] * 3;
+			bounds.Extend(glm::vec3(vertex[0], vertex[1], vertex[2]));
+		}
+	}
+	return bounds;
+}
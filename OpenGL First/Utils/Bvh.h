@@ -0,0 +1,765 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "utils/BoundsUtils.h"
+#include "utils/ParallelUtils.h"
+
+//Bounding volume hierarchy over indexed triangles, built with binned SAH
+//--------------------------------------------------------------------------------------------------
+
+const unsigned int BVH_BINS = 16;
+const unsigned int BVH_MAX_LEAF_TRIANGLES = 8;
+const unsigned int BVH_PACK_WIDTH = 4;
+const unsigned int BVH_MAX_DEPTH = 64;
+const unsigned int BVH_NO_TRIANGLE = 0xFFFFFFFF;
+//Cost of testing both children of a node relative to intersecting one triangle pack
+const float BVH_TRAVERSAL_COST = 1.0f;
+
+//32 byte node, children of an inner node are stored next to each other
+struct BvhNode
+{
+	float min[3];
+	//First child of an inner node, first triangle pack of a leaf
+	unsigned int first;
+	float max[3];
+	//Triangles of a leaf, 0 for an inner node
+	unsigned int count;
+};
+
+//Four leaf triangles as first vertex and two edges, one triangle per lane so kernels run over lanes
+struct BvhTrianglePack
+{
+	float v0[3][BVH_PACK_WIDTH];
+	float edge1[3][BVH_PACK_WIDTH];
+	float edge2[3][BVH_PACK_WIDTH];
+	unsigned int triangles[BVH_PACK_WIDTH];
+};
+
+//Hits are searched in [tMin, tMax) along the direction, which doesn't have to be normalized
+struct BvhRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 inverseDirection;
+	float tMin;
+	float tMax;
+
+	BvhRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, float maxDistance = FLT_MAX, float minDistance = 0.0f) :
+		origin(rayOrigin), direction(rayDirection), tMin(minDistance), tMax(maxDistance)
+	{
+		for (unsigned int i = 0; i < 3; i++)
+			inverseDirection[i] = direction[i] != 0.0f ? 1.0f / direction[i] : FLT_MAX;
+	}
+};
+
+//Hit distance is in direction lengths, u and v are barycentric weights of the second and third vertex
+struct BvhHit
+{
+	unsigned int triangle;
+	float distance;
+	float u;
+	float v;
+
+	BvhHit() : triangle(BVH_NO_TRIANGLE), distance(FLT_MAX), u(0.0f), v(0.0f) {}
+};
+
+//Slab test of both children at once, misses get FLT_MAX distance
+inline void intersectChildren(const BvhNode* children, const BvhRay& ray, float maxDistance, float distances[2])
+{
+	for (unsigned int c = 0; c < 2; c++)
+	{
+		float tEnter = ray.tMin;
+		float tExit = maxDistance;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float tNear = (children[c].min[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+			float tFar = (children[c].max[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+			tEnter = std::max(tEnter, std::min(tNear, tFar));
+			tExit = std::min(tExit, std::max(tNear, tFar));
+		}
+		distances[c] = tEnter <= tExit ? tEnter : FLT_MAX;
+	}
+}
+
+//Moller-Trumbore on all lanes without branches (double sided), misses get FLT_MAX distance
+inline void intersectPack(const BvhTrianglePack& pack, const BvhRay& ray, float maxDistance, float distances[BVH_PACK_WIDTH], float us[BVH_PACK_WIDTH], float vs[BVH_PACK_WIDTH])
+{
+	const glm::vec3& o = ray.origin;
+	const glm::vec3& d = ray.direction;
+	for (unsigned int lane = 0; lane < BVH_PACK_WIDTH; lane++)
+	{
+		float e1x = pack.edge1[0][lane], e1y = pack.edge1[1][lane], e1z = pack.edge1[2][lane];
+		float e2x = pack.edge2[0][lane], e2y = pack.edge2[1][lane], e2z = pack.edge2[2][lane];
+
+		float px = d.y * e2z - d.z * e2y;
+		float py = d.z * e2x - d.x * e2z;
+		float pz = d.x * e2y - d.y * e2x;
+		float det = e1x * px + e1y * py + e1z * pz;
+		float inverseDet = 1.0f / det;
+
+		float tx = o.x - pack.v0[0][lane], ty = o.y - pack.v0[1][lane], tz = o.z - pack.v0[2][lane];
+		float u = (tx * px + ty * py + tz * pz) * inverseDet;
+
+		float qx = ty * e1z - tz * e1y;
+		float qy = tz * e1x - tx * e1z;
+		float qz = tx * e1y - ty * e1x;
+		float v = (d.x * qx + d.y * qy + d.z * qz) * inverseDet;
+		float t = (e2x * qx + e2y * qy + e2z * qz) * inverseDet;
+
+		// Non short-circuit & keeps the lanes free of branches, det == 0 gives inf or NaN that fail the tests anyway
+		bool hit = (det != 0.0f) & (u >= 0.0f) & (v >= 0.0f) & (u + v <= 1.0f) & (t >= ray.tMin) & (t < maxDistance);
+		distances[lane] = hit ? t : FLT_MAX;
+		us[lane] = u;
+		vs[lane] = v;
+	}
+}
+
+//Separating axis test of triangle and box (Akenine-Moller), vertices are relative to the box center
+inline bool triangleOverlapsBox(const glm::vec3 v[3], const glm::vec3& halfSize)
+{
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		float minValue = std::min(v[0][axis], std::min(v[1][axis], v[2][axis]));
+		float maxValue = std::max(v[0][axis], std::max(v[1][axis], v[2][axis]));
+		if (minValue > halfSize[axis] || maxValue < -halfSize[axis])
+			return false;
+	}
+
+	glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+	glm::vec3 normal = glm::cross(edges[0], edges[1]);
+	float planeRadius = halfSize.x * glm::abs(normal.x) + halfSize.y * glm::abs(normal.y) + halfSize.z * glm::abs(normal.z);
+	if (glm::abs(glm::dot(normal, v[0])) > planeRadius)
+		return false;
+
+	// Cross products of box axes and triangle edges
+	for (unsigned int e = 0; e < 3; e++)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			glm::vec3 boxAxis(0.0f);
+			boxAxis[axis] = 1.0f;
+			glm::vec3 separating = glm::cross(boxAxis, edges[e]);
+			float p0 = glm::dot(separating, v[0]);
+			float p1 = glm::dot(separating, v[1]);
+			float p2 = glm::dot(separating, v[2]);
+			float radius = halfSize.x * glm::abs(separating.x) + halfSize.y * glm::abs(separating.y) + halfSize.z * glm::abs(separating.z);
+			if (std::min(p0, std::min(p1, p2)) > radius || std::max(p0, std::max(p1, p2)) < -radius)
+				return false;
+		}
+	}
+	return true;
+}
+
+class Bvh
+{
+public:
+
+	//Builds over triangles 0..trianglesCount-1 of the index array, results refer to these triangle numbers
+	Bvh(const float* vertices, const unsigned int* indices, unsigned int trianglesCount, unsigned int workers = 0)
+	{
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		if (workers == 0)
+			workers = GetWorkerCount();
+		build(vertices, indices, trianglesCount, workers);
+		buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+	}
+
+	//Closest hit along the ray
+	bool IntersectNearest(const BvhRay& ray, BvhHit& hit) const
+	{
+		hit = BvhHit();
+		hit.distance = ray.tMax;
+		traverse(ray, hit, false);
+		return hit.triangle != BVH_NO_TRIANGLE;
+	}
+
+	//Any hit along the ray, stops at the first one found
+	bool IntersectAny(const BvhRay& ray) const
+	{
+		BvhHit hit;
+		hit.distance = ray.tMax;
+		traverse(ray, hit, true);
+		return hit.triangle != BVH_NO_TRIANGLE;
+	}
+
+	//Appends triangles overlapping the box
+	void QueryBox(const BoundingBox& box, std::vector<unsigned int>& triangles) const
+	{
+		if (nodes.empty())
+			return;
+
+		glm::vec3 center = box.Center();
+		glm::vec3 halfSize = box.Size() * 0.5f;
+		unsigned int stack[BVH_MAX_DEPTH];
+		unsigned int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BvhNode& node = nodes[stack[--stackSize]];
+			bool overlaps = true;
+			for (unsigned int axis = 0; axis < 3; axis++)
+				overlaps = overlaps && node.min[axis] <= box.max[axis] && node.max[axis] >= box.min[axis];
+			if (!overlaps)
+				continue;
+
+			if (node.count == 0)
+			{
+				stack[stackSize++] = node.first;
+				stack[stackSize++] = node.first + 1;
+				continue;
+			}
+
+			for (unsigned int i = 0; i < node.count; i++)
+			{
+				const BvhTrianglePack& pack = packs[node.first + i / BVH_PACK_WIDTH];
+				unsigned int lane = i % BVH_PACK_WIDTH;
+				glm::vec3 v[3];
+				v[0] = glm::vec3(pack.v0[0][lane], pack.v0[1][lane], pack.v0[2][lane]);
+				v[1] = v[0] + glm::vec3(pack.edge1[0][lane], pack.edge1[1][lane], pack.edge1[2][lane]);
+				v[2] = v[0] + glm::vec3(pack.edge2[0][lane], pack.edge2[1][lane], pack.edge2[2][lane]);
+				for (unsigned int k = 0; k < 3; k++)
+					v[k] -= center;
+				if (triangleOverlapsBox(v, halfSize))
+					triangles.push_back(pack.triangles[lane]);
+			}
+		}
+	}
+
+	BoundingBox GetBounds() const
+	{
+		if (nodes.empty())
+			return BoundingBox();
+		return BoundingBox(glm::vec3(nodes[0].min[0], nodes[0].min[1], nodes[0].min[2]), glm::vec3(nodes[0].max[0], nodes[0].max[1], nodes[0].max[2]));
+	}
+
+	unsigned int GetNodesCount() const
+	{
+		return nodes.size();
+	}
+
+	size_t GetMemoryUsage() const
+	{
+		return nodes.size() * sizeof(BvhNode) + packs.size() * sizeof(BvhTrianglePack);
+	}
+
+	//Build time in milliseconds
+	double GetBuildTime() const
+	{
+		return buildTime;
+	}
+
+private:
+
+	std::vector<BvhNode> nodes;
+	std::vector<BvhTrianglePack> packs;
+	double buildTime = 0.0;
+
+	//Build state, released when the build is done
+	std::vector<BoundingBox> trianglesBounds;
+	std::vector<glm::vec3> centroids;
+	std::vector<unsigned int> order;
+
+	struct BuildTask
+	{
+		unsigned int node;
+		unsigned int first;
+		unsigned int count;
+		unsigned int depth;
+	};
+
+	struct Bin
+	{
+		BoundingBox bounds;
+		unsigned int count = 0;
+	};
+
+	static BvhNode makeNode(const BoundingBox& bounds)
+	{
+		BvhNode node;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			node.min[axis] = bounds.min[axis];
+			node.max[axis] = bounds.max[axis];
+		}
+		node.first = 0;
+		node.count = 0;
+		return node;
+	}
+
+	static unsigned int packsCount(unsigned int trianglesCount)
+	{
+		return (trianglesCount + BVH_PACK_WIDTH - 1) / BVH_PACK_WIDTH;
+	}
+
+	static float surfaceArea(const BoundingBox& box)
+	{
+		if (box.IsEmpty())
+			return 0.0f;
+		glm::vec3 size = box.Size();
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	void build(const float* vertices, const unsigned int* indices, unsigned int trianglesCount, unsigned int workers)
+	{
+		if (trianglesCount == 0)
+			return;
+
+		trianglesBounds.resize(trianglesCount);
+		centroids.resize(trianglesCount);
+		order.resize(trianglesCount);
+		unsigned int chunks = (trianglesCount + BOUNDS_CHUNK_SIZE - 1) / BOUNDS_CHUNK_SIZE;
+		std::vector<BoundingBox> chunksBounds(chunks);
+		ParallelFor(chunks, [&](unsigned int chunk)
+		{
+			unsigned int last = std::min((chunk + 1) * BOUNDS_CHUNK_SIZE, trianglesCount);
+			for (unsigned int i = chunk * BOUNDS_CHUNK_SIZE; i < last; i++)
+			{
+				trianglesBounds[i] = ComputeTrianglesBounds(vertices, indices, &i, 1);
+				centroids[i] = trianglesBounds[i].Center();
+				order[i] = i;
+				chunksBounds[chunk].Extend(trianglesBounds[i]);
+			}
+		}, workers);
+
+		BoundingBox bounds;
+		for (unsigned int i = 0; i < chunks; i++)
+			bounds.Extend(chunksBounds[i]);
+
+		// Top of the tree is split first with workers binning the large ranges, once subtrees are small
+		// enough to give every worker several they are built as independent tasks
+		nodes.reserve(trianglesCount / BVH_PACK_WIDTH * 2 + 1);
+		nodes.push_back(makeNode(bounds));
+		std::vector<BuildTask> tasks;
+		unsigned int taskSize = workers > 1 ? std::max(trianglesCount / (workers * 8), BVH_MAX_LEAF_TRIANGLES) : trianglesCount;
+		BuildTask root = { 0, 0, trianglesCount, 0 };
+		buildNodes(nodes, root, workers > 1 ? &tasks : NULL, taskSize, workers);
+
+		std::vector<std::vector<BvhNode>> subtrees(tasks.size());
+		ParallelFor(tasks.size(), [&](unsigned int i)
+		{
+			subtrees[i].push_back(nodes[tasks[i].node]);
+			BuildTask task = { 0, tasks[i].first, tasks[i].count, tasks[i].depth };
+			buildNodes(subtrees[i], task, NULL, 0, 1);
+		}, workers);
+
+		// Subtree nodes are appended, their root replaces the placeholder so children stay next to each other
+		for (unsigned int i = 0; i < tasks.size(); i++)
+		{
+			unsigned int base = nodes.size() - 1;
+			for (unsigned int j = 0; j < subtrees[i].size(); j++)
+			{
+				BvhNode node = subtrees[i][j];
+				if (node.count == 0)
+					node.first += base;
+				if (j == 0)
+					nodes[tasks[i].node] = node;
+				else
+					nodes.push_back(node);
+			}
+			std::vector<BvhNode>().swap(subtrees[i]);
+		}
+
+		createPacks(vertices, indices);
+
+		std::vector<BoundingBox>().swap(trianglesBounds);
+		std::vector<glm::vec3>().swap(centroids);
+		std::vector<unsigned int>().swap(order);
+	}
+
+	//Splits nodes depth first, ranges of at most taskSize triangles are left to tasks when tasks are collected.
+	//Workers bin the large ranges at the top, subtree tasks build with one worker each.
+	void buildNodes(std::vector<BvhNode>& output, const BuildTask& root, std::vector<BuildTask>* tasks, unsigned int taskSize, unsigned int workers)
+	{
+		std::vector<BuildTask> stack;
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			BuildTask task = stack.back();
+			stack.pop_back();
+			if (tasks != NULL && task.count <= taskSize)
+			{
+				tasks->push_back(task);
+				continue;
+			}
+
+			unsigned int leftCount;
+			BoundingBox leftBounds, rightBounds;
+			const BvhNode& node = output[task.node];
+			BoundingBox nodeBounds(glm::vec3(node.min[0], node.min[1], node.min[2]), glm::vec3(node.max[0], node.max[1], node.max[2]));
+			// Depth is limited so traversal stacks of BVH_MAX_DEPTH entries never overflow
+			if (task.depth + 1 >= BVH_MAX_DEPTH || !splitRange(task.first, task.count, nodeBounds, leftCount, leftBounds, rightBounds, workers))
+			{
+				output[task.node].first = task.first;
+				output[task.node].count = task.count;
+				continue;
+			}
+
+			unsigned int left = output.size();
+			output[task.node].first = left;
+			output[task.node].count = 0;
+			output.push_back(makeNode(leftBounds));
+			output.push_back(makeNode(rightBounds));
+
+			BuildTask rightTask = { left + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 };
+			BuildTask leftTask = { left, task.first, leftCount, task.depth + 1 };
+			stack.push_back(rightTask);
+			stack.push_back(leftTask);
+		}
+	}
+
+	//Bins the range on all axes in one pass, large ranges are split into chunks binned by the workers
+	void binRange(unsigned int first, unsigned int count, const BoundingBox& centroidBounds, Bin bins[3][BVH_BINS], unsigned int workers)
+	{
+		glm::vec3 extent = centroidBounds.Size();
+		glm::vec3 scale;
+		for (unsigned int axis = 0; axis < 3; axis++)
+			scale[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+
+		auto binTriangles = [&](unsigned int begin, unsigned int end, Bin* target)
+		{
+			for (unsigned int i = begin; i < end; i++)
+			{
+				unsigned int triangle = order[i];
+				for (unsigned int axis = 0; axis < 3; axis++)
+				{
+					unsigned int bin = std::min((unsigned int)((centroids[triangle][axis] - centroidBounds.min[axis]) * scale[axis]), BVH_BINS - 1);
+					target[axis * BVH_BINS + bin].bounds.Extend(trianglesBounds[triangle]);
+					target[axis * BVH_BINS + bin].count++;
+				}
+			}
+		};
+
+		if (workers <= 1 || count <= BOUNDS_CHUNK_SIZE)
+		{
+			binTriangles(first, first + count, &bins[0][0]);
+			return;
+		}
+
+		unsigned int chunks = (count + BOUNDS_CHUNK_SIZE - 1) / BOUNDS_CHUNK_SIZE;
+		std::vector<Bin> chunksBins(chunks * 3 * BVH_BINS);
+		ParallelFor(chunks, [&](unsigned int chunk)
+		{
+			unsigned int begin = first + chunk * BOUNDS_CHUNK_SIZE;
+			binTriangles(begin, std::min(begin + BOUNDS_CHUNK_SIZE, first + count), chunksBins.data() + chunk * 3 * BVH_BINS);
+		}, workers);
+
+		for (unsigned int chunk = 0; chunk < chunks; chunk++)
+		{
+			for (unsigned int bin = 0; bin < 3 * BVH_BINS; bin++)
+			{
+				const Bin& chunkBin = chunksBins[chunk * 3 * BVH_BINS + bin];
+				bins[bin / BVH_BINS][bin % BVH_BINS].bounds.Extend(chunkBin.bounds);
+				bins[bin / BVH_BINS][bin % BVH_BINS].count += chunkBin.count;
+			}
+		}
+	}
+
+	BoundingBox centroidsBounds(unsigned int first, unsigned int count, unsigned int workers)
+	{
+		auto boundCentroids = [&](unsigned int begin, unsigned int end)
+		{
+			BoundingBox bounds;
+			for (unsigned int i = begin; i < end; i++)
+				bounds.Extend(centroids[order[i]]);
+			return bounds;
+		};
+
+		if (workers <= 1 || count <= BOUNDS_CHUNK_SIZE)
+			return boundCentroids(first, first + count);
+
+		unsigned int chunks = (count + BOUNDS_CHUNK_SIZE - 1) / BOUNDS_CHUNK_SIZE;
+		std::vector<BoundingBox> chunksBounds(chunks);
+		ParallelFor(chunks, [&](unsigned int chunk)
+		{
+			unsigned int begin = first + chunk * BOUNDS_CHUNK_SIZE;
+			chunksBounds[chunk] = boundCentroids(begin, std::min(begin + BOUNDS_CHUNK_SIZE, first + count));
+		}, workers);
+
+		BoundingBox bounds;
+		for (unsigned int i = 0; i < chunks; i++)
+			bounds.Extend(chunksBounds[i]);
+		return bounds;
+	}
+
+	//Best binned SAH split of the range over all axes, partitions order and returns false if a leaf is cheaper.
+	//Leaves are intersected a pack at a time, so costs count packs rather than triangles.
+	bool splitRange(unsigned int first, unsigned int count, const BoundingBox& nodeBounds, unsigned int& leftCount, BoundingBox& leftBounds, BoundingBox& rightBounds, unsigned int workers)
+	{
+		// A leaf of one pack is never worse than two leaves
+		if (count <= BVH_PACK_WIDTH)
+			return false;
+
+		BoundingBox centroidBounds = centroidsBounds(first, count, workers);
+		Bin bins[3][BVH_BINS];
+		binRange(first, count, centroidBounds, bins, workers);
+
+		float bestCost = FLT_MAX;
+		unsigned int bestAxis = 0;
+		unsigned int bestSplit = 0;
+		glm::vec3 extent = centroidBounds.Size();
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f)
+				continue;
+
+			// Right side bounds and counts swept from the end, left side while evaluating
+			BoundingBox rightSweep[BVH_BINS];
+			unsigned int rightCounts[BVH_BINS];
+			BoundingBox sweep;
+			unsigned int sweepCount = 0;
+			for (unsigned int bin = BVH_BINS - 1; bin > 0; bin--)
+			{
+				sweep.Extend(bins[axis][bin].bounds);
+				sweepCount += bins[axis][bin].count;
+				rightSweep[bin] = sweep;
+				rightCounts[bin] = sweepCount;
+			}
+
+			sweep = BoundingBox();
+			sweepCount = 0;
+			for (unsigned int split = 1; split < BVH_BINS; split++)
+			{
+				sweep.Extend(bins[axis][split - 1].bounds);
+				sweepCount += bins[axis][split - 1].count;
+				if (sweepCount == 0 || rightCounts[split] == 0)
+					continue;
+
+				float cost = surfaceArea(sweep) * packsCount(sweepCount) + surfaceArea(rightSweep[split]) * packsCount(rightCounts[split]);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+					leftCount = sweepCount;
+					leftBounds = sweep;
+					rightBounds = rightSweep[split];
+				}
+			}
+		}
+
+		float nodeArea = surfaceArea(nodeBounds);
+		float splitCost = BVH_TRAVERSAL_COST + (nodeArea > 0.0f ? bestCost / nodeArea : 0.0f);
+		if ((bestSplit == 0 || splitCost >= packsCount(count)) && count <= BVH_MAX_LEAF_TRIANGLES)
+			return false;
+
+		unsigned int* rangeBegin = order.data() + first;
+		unsigned int* rangeEnd = rangeBegin + count;
+		if (bestSplit > 0)
+		{
+			// Same bin computation as binRange, so the sides get exactly the binned counts and bounds
+			float scale = BVH_BINS / extent[bestAxis];
+			float minCentroid = centroidBounds.min[bestAxis];
+			std::partition(rangeBegin, rangeEnd, [&](unsigned int triangle)
+			{
+				return std::min((unsigned int)((centroids[triangle][bestAxis] - minCentroid) * scale), BVH_BINS - 1) < bestSplit;
+			});
+			return true;
+		}
+
+		// Centroids all in one point are divided in halves
+		leftCount = count / 2;
+		leftBounds = BoundingBox();
+		rightBounds = BoundingBox();
+		for (unsigned int* triangle = rangeBegin; triangle < rangeBegin + leftCount; triangle++)
+			leftBounds.Extend(trianglesBounds[*triangle]);
+		for (unsigned int* triangle = rangeBegin + leftCount; triangle < rangeEnd; triangle++)
+			rightBounds.Extend(trianglesBounds[*triangle]);
+		return true;
+	}
+
+	//Copies leaf triangles in leaf order into packs, unused lanes stay degenerate and never hit
+	void createPacks(const float* vertices, const unsigned int* indices)
+	{
+		unsigned int totalPacks = 0;
+		for (unsigned int i = 0; i < nodes.size(); i++)
+			totalPacks += packsCount(nodes[i].count);
+
+		BvhTrianglePack emptyPack;
+		memset(&emptyPack, 0, sizeof(emptyPack));
+		for (unsigned int lane = 0; lane < BVH_PACK_WIDTH; lane++)
+			emptyPack.triangles[lane] = BVH_NO_TRIANGLE;
+		packs.assign(totalPacks, emptyPack);
+
+		unsigned int pack = 0;
+		for (unsigned int i = 0; i < nodes.size(); i++)
+		{
+			if (nodes[i].count == 0)
+				continue;
+
+			unsigned int firstTriangle = nodes[i].first;
+			nodes[i].first = pack;
+			for (unsigned int t = 0; t < nodes[i].count; t++)
+			{
+				BvhTrianglePack& target = packs[pack + t / BVH_PACK_WIDTH];
+				unsigned int lane = t % BVH_PACK_WIDTH;
+				unsigned int triangle = order[firstTriangle + t];
+				const float* v0 = vertices + (size_t)indices[triangle * 3] * 3;
+				const float* v1 = vertices + (size_t)indices[triangle * 3 + 1] * 3;
+				const float* v2 = vertices + (size_t)indices[triangle * 3 + 2] * 3;
+				for (unsigned int axis = 0; axis < 3; axis++)
+				{
+					target.v0[axis][lane] = v0[axis];
+					target.edge1[axis][lane] = v1[axis] - v0[axis];
+					target.edge2[axis][lane] = v2[axis] - v0[axis];
+				}
+				target.triangles[lane] = triangle;
+			}
+			pack += packsCount(nodes[i].count);
+		}
+	}
+
+	//Front to back traversal, nearer child first and farther one on the stack while it can still be hit
+	void traverse(const BvhRay& ray, BvhHit& hit, bool anyHit) const
+	{
+		if (nodes.empty())
+			return;
+
+		float rootDistance[2];
+		BvhNode root[2] = { nodes[0], nodes[0] };
+		intersectChildren(root, ray, hit.distance, rootDistance);
+		if (rootDistance[0] == FLT_MAX)
+			return;
+
+		struct StackEntry
+		{
+			unsigned int node;
+			float distance;
+		};
+		StackEntry stack[BVH_MAX_DEPTH];
+		unsigned int stackSize = 0;
+		unsigned int current = 0;
+
+		while (true)
+		{
+			const BvhNode& node = nodes[current];
+			if (node.count > 0)
+			{
+				unsigned int leafPacks = packsCount(node.count);
+				for (unsigned int p = 0; p < leafPacks; p++)
+				{
+					const BvhTrianglePack& pack = packs[node.first + p];
+					float distances[BVH_PACK_WIDTH], us[BVH_PACK_WIDTH], vs[BVH_PACK_WIDTH];
+					intersectPack(pack, ray, hit.distance, distances, us, vs);
+					for (unsigned int lane = 0; lane < BVH_PACK_WIDTH; lane++)
+					{
+						if (distances[lane] < hit.distance)
+						{
+							hit.triangle = pack.triangles[lane];
+							hit.distance = distances[lane];
+							hit.u = us[lane];
+							hit.v = vs[lane];
+						}
+					}
+					if (anyHit && hit.triangle != BVH_NO_TRIANGLE)
+						return;
+				}
+			}
+			else
+			{
+				float distances[2];
+				intersectChildren(&nodes[node.first], ray, hit.distance, distances);
+				unsigned int nearChild = distances[1] < distances[0] ? 1 : 0;
+				float nearDistance = distances[nearChild];
+				float farDistance = distances[1 - nearChild];
+
+				if (nearDistance != FLT_MAX)
+				{
+					if (farDistance != FLT_MAX)
+					{
+						stack[stackSize].node = node.first + 1 - nearChild;
+						stack[stackSize].distance = farDistance;
+						stackSize++;
+					}
+					current = node.first + nearChild;
+					continue;
+				}
+			}
+
+			// Entries farther than the closest hit found meanwhile are skipped
+			bool found = false;
+			while (stackSize > 0 && !found)
+			{
+				stackSize--;
+				found = stack[stackSize].distance <= hit.distance;
+				current = stack[stackSize].node;
+			}
+			if (!found)
+				return;
+		}
+	}
+};
+
+//Rays per second of both query kinds, rays go from random points around the bounding sphere to random points inside it
+struct BvhBenchmark
+{
+	unsigned int rays = 0;
+	unsigned int hits = 0;
+	unsigned int anyHits = 0;
+	double nearestRaysPerSecond = 0.0;
+	double anyRaysPerSecond = 0.0;
+};
+
+inline BvhBenchmark RunBvhBenchmark(const Bvh& bvh, const BoundingSphere& sphere, unsigned int raysCount = 1 << 20, unsigned int workers = 0)
+{
+	const unsigned int RAYS_CHUNK_SIZE = 4096;
+	BvhBenchmark benchmark;
+	benchmark.rays = raysCount;
+
+	// Fixed seed per ray keeps runs comparable
+	auto randomUnit = [](uint32_t& state)
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (1.0f / 16777216.0f) * 2.0f - 1.0f;
+	};
+	std::vector<BvhRay> rays;
+	rays.reserve(raysCount);
+	uint32_t state = 12345;
+	for (unsigned int i = 0; i < raysCount; i++)
+	{
+		glm::vec3 from(randomUnit(state), randomUnit(state), randomUnit(state));
+		glm::vec3 to(randomUnit(state), randomUnit(state), randomUnit(state));
+		float length = glm::length(from);
+		from = sphere.center + (length > 0.0f ? from / length : glm::vec3(0.0f, 1.0f, 0.0f)) * sphere.radius * 1.5f;
+		to = sphere.center + to * sphere.radius * 0.5f;
+		rays.push_back(BvhRay(from, to - from));
+	}
+
+	unsigned int chunks = (raysCount + RAYS_CHUNK_SIZE - 1) / RAYS_CHUNK_SIZE;
+	std::vector<unsigned int> chunksHits(chunks, 0);
+	std::vector<unsigned int> chunksAnyHits(chunks, 0);
+	auto start = std::chrono::high_resolution_clock::now();
+	ParallelFor(chunks, [&](unsigned int chunk)
+	{
+		BvhHit hit;
+		unsigned int last = std::min((chunk + 1) * RAYS_CHUNK_SIZE, raysCount);
+		for (unsigned int i = chunk * RAYS_CHUNK_SIZE; i < last; i++)
+			chunksHits[chunk] += bvh.IntersectNearest(rays[i], hit) ? 1 : 0;
+	}, workers);
+	double nearestSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	ParallelFor(chunks, [&](unsigned int chunk)
+	{
+		unsigned int last = std::min((chunk + 1) * RAYS_CHUNK_SIZE, raysCount);
+		for (unsigned int i = chunk * RAYS_CHUNK_SIZE; i < last; i++)
+			chunksAnyHits[chunk] += bvh.IntersectAny(rays[i]) ? 1 : 0;
+	}, workers);
+	double anySeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	for (unsigned int i = 0; i < chunks; i++)
+	{
+		benchmark.hits += chunksHits[i];
+		benchmark.anyHits += chunksAnyHits[i];
+	}
+	benchmark.nearestRaysPerSecond = nearestSeconds > 0.0 ? raysCount / nearestSeconds : 0.0;
+	benchmark.anyRaysPerSecond = anySeconds > 0.0 ? raysCount / anySeconds : 0.0;
+	return benchmark;
+}
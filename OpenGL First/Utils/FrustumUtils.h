@@ -0,0 +1,148 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+
+#include "utils/BoundsUtils.h"
+
+//Views one culling pass can test at once, visibility of every box fits in a byte
+const unsigned int MAX_CULLING_VIEWS = 8;
+
+//View frustum as six planes extracted from projection * view (Gribb-Hartmann), normals point inside
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	Frustum() {}
+
+	Frustum(const glm::mat4& viewProjection)
+	{
+		glm::vec4 rows[4];
+		for (unsigned int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		// Left, right, bottom, top, near, far
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			planes[i * 2] = rows[3] + rows[i];
+			planes[i * 2 + 1] = rows[3] - rows[i];
+		}
+
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			float length = glm::length(glm::vec3(planes[i]));
+			if (length > 0.0f)
+				planes[i] /= length;
+		}
+	}
+
+	bool IntersectsSphere(const glm::vec3& center, float radius) const
+	{
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	bool IntersectsBox(const BoundingBox& box) const
+	{
+		glm::vec3 center = box.Center();
+		glm::vec3 extent = box.Size() * 0.5f;
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal(planes[i]);
+			float radius = glm::dot(glm::abs(normal), extent);
+			if (glm::dot(normal, center) + planes[i].w < -radius)
+				return false;
+		}
+		return true;
+	}
+};
+
+//What culling needs to know about one view. Orthographic views have no camera position, only a view direction.
+//Level of detail selection needs the viewport height in pixels, 0 when unknown.
+struct CullingView
+{
+	Frustum frustum;
+	glm::mat4 viewProjection;
+	bool orthographic;
+	glm::vec3 cameraPosition;
+	glm::vec3 viewDirection;
+	//Vertical scale of the projection, NDC units per world unit (per world unit at depth 1 for perspective)
+	float projectionScale;
+	float viewportHeight;
+
+	CullingView() : orthographic(false), cameraPosition(0.0f), viewDirection(0.0f, 0.0f, -1.0f), projectionScale(1.0f), viewportHeight(0.0f) {}
+
+	CullingView(const glm::mat4& view, const glm::mat4& projection, float viewportPixelsHeight = 0.0f) :
+		frustum(projection * view), viewProjection(projection * view), projectionScale(projection[1][1]), viewportHeight(viewportPixelsHeight)
+	{
+		// Perspective projection copies -z into w, orthographic one keeps w = 1
+		orthographic = projection[2][3] == 0.0f;
+		cameraPosition = glm::vec3(glm::inverse(view)[3]);
+		viewDirection = glm::normalize(-glm::vec3(view[0][2], view[1][2], view[2][2]));
+	}
+};
+
+//Planes of several frusta as structure of arrays, so a box is tested against every plane of every view in one loop
+struct FrustaPlanes
+{
+	float x[MAX_CULLING_VIEWS * 6];
+	float y[MAX_CULLING_VIEWS * 6];
+	float z[MAX_CULLING_VIEWS * 6];
+	float w[MAX_CULLING_VIEWS * 6];
+	unsigned int viewsCount;
+
+	FrustaPlanes(const CullingView* views, unsigned int count) : viewsCount(std::min(count, MAX_CULLING_VIEWS))
+	{
+		for (unsigned int v = 0; v < viewsCount; v++)
+		{
+			for (unsigned int i = 0; i < 6; i++)
+			{
+				const glm::vec4& plane = views[v].frustum.planes[i];
+				x[v * 6 + i] = plane.x;
+				y[v * 6 + i] = plane.y;
+				z[v * 6 + i] = plane.z;
+				w[v * 6 + i] = plane.w;
+			}
+		}
+	}
+};
+
+//Bit v of masks[i] is set when box i intersects frustum v, empty boxes are visible in no view
+inline void CullBoxes(const FrustaPlanes& frusta, const BoundingBox* boxes, unsigned int boxesCount, uint8_t* masks)
+{
+	const unsigned int planesCount = frusta.viewsCount * 6;
+	for (unsigned int i = 0; i < boxesCount; i++)
+	{
+		if (boxes[i].IsEmpty())
+		{
+			masks[i] = 0;
+			continue;
+		}
+
+		glm::vec3 center = boxes[i].Center();
+		glm::vec3 extent = boxes[i].Size() * 0.5f;
+
+		// Distance of the box center to the plane plus the box radius along the plane normal, negative when outside
+		float distances[MAX_CULLING_VIEWS * 6];
+		for (unsigned int p = 0; p < planesCount; p++)
+		{
+			distances[p] = frusta.x[p] * center.x + frusta.y[p] * center.y + frusta.z[p] * center.z + frusta.w[p] +
+				glm::abs(frusta.x[p]) * extent.x + glm::abs(frusta.y[p]) * extent.y + glm::abs(frusta.z[p]) * extent.z;
+		}
+
+		uint8_t mask = 0;
+		for (unsigned int v = 0; v < frusta.viewsCount; v++)
+		{
+			bool inside = true;
+			for (unsigned int p = v * 6; p < v * 6 + 6; p++)
+				inside = inside && distances[p] >= 0.0f;
+			mask |= (inside ? 1 : 0) << v;
+		}
+		masks[i] = mask;
+	}
+}
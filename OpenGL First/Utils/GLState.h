@@ -0,0 +1,280 @@
+#pragma once
+
+#include <glad/glad.h>
+
+//Uniform buffer binding points whose ranges are tracked, the blocks of UniformBuffer.h use the first ones
+const unsigned int GL_STATE_UNIFORM_BINDINGS = 8;
+//Capabilities tracked by SetEnabled: depth test, face culling, blending and 8 clip distances
+const unsigned int GL_STATE_CAPABILITIES = 11;
+
+//Calls sent to the driver and calls dropped because they would set the current value, in the current frame
+struct GLStateStatistics
+{
+	unsigned int issued = 0;
+	unsigned int elided = 0;
+};
+
+//Shadow of the GL state the renderer changes. Renderer code binds and enables through it, calls that would set
+//the value already set are dropped. State changed behind its back (by ImGui) has to be forgotten with Invalidate.
+class GLStateCache
+{
+public:
+	GLStateCache()
+	{
+		Invalidate();
+	}
+
+	//Forgets all shadowed values, the next call of every kind is sent to the driver
+	void Invalidate()
+	{
+		program = UNKNOWN;
+		read_framebuffer = UNKNOWN;
+		draw_framebuffer = UNKNOWN;
+		vertex_array = UNKNOWN;
+		array_buffer = UNKNOWN;
+		uniform_buffer = UNKNOWN;
+		for (unsigned int i = 0; i < GL_STATE_UNIFORM_BINDINGS; i++)
+			uniform_ranges[i].buffer = UNKNOWN;
+		viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+		polygon_mode = UNKNOWN;
+		depth_func = UNKNOWN;
+		depth_mask = -1;
+		for (unsigned int i = 0; i < GL_STATE_CAPABILITIES; i++)
+			capabilities[i] = -1;
+	}
+
+	void BeginFrame()
+	{
+		statistics = GLStateStatistics();
+	}
+
+	//Counting costs a branch per call, so it is off unless the statistics are shown
+	void SetStatisticsEnabled(bool enabled)
+	{
+		statistics_enabled = enabled;
+	}
+
+	bool IsStatisticsEnabled() const
+	{
+		return statistics_enabled;
+	}
+
+	const GLStateStatistics& GetStatistics() const
+	{
+		return statistics;
+	}
+
+	void UseProgram(GLuint id)
+	{
+		if (changed(program, id))
+			glUseProgram(id);
+	}
+
+	//GL_FRAMEBUFFER binds both the read and the draw framebuffer
+	void BindFramebuffer(GLenum target, GLuint id)
+	{
+		bool read = target != GL_DRAW_FRAMEBUFFER;
+		bool draw = target != GL_READ_FRAMEBUFFER;
+		bool same = (!read || read_framebuffer == id) && (!draw || draw_framebuffer == id);
+		count(!same);
+		if (same)
+			return;
+		if (read)
+			read_framebuffer = id;
+		if (draw)
+			draw_framebuffer = id;
+		glBindFramebuffer(target, id);
+	}
+
+	void BindVertexArray(GLuint id)
+	{
+		if (changed(vertex_array, id))
+			glBindVertexArray(id);
+	}
+
+	void BindBuffer(GLenum target, GLuint id)
+	{
+		GLuint* bound = target == GL_ARRAY_BUFFER ? &array_buffer : target == GL_UNIFORM_BUFFER ? &uniform_buffer : NULL;
+		if (bound == NULL)
+		{
+			// Element array binding is vertex array state, it is always sent
+			count(true);
+			glBindBuffer(target, id);
+		}
+		else if (changed(*bound, id))
+		{
+			glBindBuffer(target, id);
+		}
+	}
+
+	//Binding a range also binds the buffer to the generic uniform buffer target
+	void BindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+	{
+		if (target != GL_UNIFORM_BUFFER || index >= GL_STATE_UNIFORM_BINDINGS)
+		{
+			count(true);
+			glBindBufferRange(target, index, id, offset, size);
+			return;
+		}
+
+		UniformRange& range = uniform_ranges[index];
+		bool same = range.buffer == id && range.offset == offset && range.size == size;
+		count(!same);
+		if (same)
+			return;
+		range.buffer = id;
+		range.offset = offset;
+		range.size = size;
+		uniform_buffer = id;
+		glBindBufferRange(target, index, id, offset, size);
+	}
+
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		bool same = viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height;
+		count(!same);
+		if (same)
+			return;
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		glViewport(x, y, width, height);
+	}
+
+	//Core profile only accepts GL_FRONT_AND_BACK
+	void PolygonMode(GLenum mode)
+	{
+		if (changed(polygon_mode, mode))
+			glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+
+	void DepthFunc(GLenum func)
+	{
+		if (changed(depth_func, func))
+			glDepthFunc(func);
+	}
+
+	void DepthMask(bool enabled)
+	{
+		int value = enabled ? 1 : 0;
+		count(depth_mask != value);
+		if (depth_mask == value)
+			return;
+		depth_mask = value;
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	}
+
+	void SetEnabled(GLenum capability, bool enabled)
+	{
+		int slot = capabilitySlot(capability);
+		int value = enabled ? 1 : 0;
+		if (slot >= 0 && capabilities[slot] == value)
+		{
+			count(false);
+			return;
+		}
+		if (slot >= 0)
+			capabilities[slot] = value;
+		count(true);
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+
+	//Deleting a bound object unbinds it, the shadow has to follow
+	void DeleteVertexArray(GLuint& id)
+	{
+		if (vertex_array == id)
+			vertex_array = 0;
+		glDeleteVertexArrays(1, &id);
+		id = 0;
+	}
+
+	void DeleteFramebuffer(GLuint& id)
+	{
+		if (read_framebuffer == id)
+			read_framebuffer = 0;
+		if (draw_framebuffer == id)
+			draw_framebuffer = 0;
+		glDeleteFramebuffers(1, &id);
+		id = 0;
+	}
+
+	void DeleteBuffer(GLuint& id)
+	{
+		if (array_buffer == id)
+			array_buffer = 0;
+		if (uniform_buffer == id)
+			uniform_buffer = 0;
+		for (unsigned int i = 0; i < GL_STATE_UNIFORM_BINDINGS; i++)
+		{
+			if (uniform_ranges[i].buffer == id)
+				uniform_ranges[i].buffer = 0;
+		}
+		glDeleteBuffers(1, &id);
+		id = 0;
+	}
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+	struct UniformRange
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	GLuint program;
+	GLuint read_framebuffer;
+	GLuint draw_framebuffer;
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint uniform_buffer;
+	UniformRange uniform_ranges[GL_STATE_UNIFORM_BINDINGS];
+	GLint viewport[4];
+	GLenum polygon_mode;
+	GLenum depth_func;
+	int depth_mask;
+	// -1 unknown, 0 disabled, 1 enabled
+	int capabilities[GL_STATE_CAPABILITIES];
+
+	bool statistics_enabled = false;
+	GLStateStatistics statistics;
+
+	//Stores the value, true when it differs from the shadowed one and the call has to be sent
+	bool changed(GLuint& current, GLuint value)
+	{
+		bool differs = current != value;
+		count(differs);
+		current = value;
+		return differs;
+	}
+
+	void count(bool issued)
+	{
+		if (!statistics_enabled)
+			return;
+		if (issued)
+			statistics.issued++;
+		else
+			statistics.elided++;
+	}
+
+	static int capabilitySlot(GLenum capability)
+	{
+		if (capability == GL_DEPTH_TEST)
+			return 0;
+		if (capability == GL_CULL_FACE)
+			return 1;
+		if (capability == GL_BLEND)
+			return 2;
+		if (capability >= GL_CLIP_DISTANCE0 && capability < GL_CLIP_DISTANCE0 + 8)
+			return 3 + (capability - GL_CLIP_DISTANCE0);
+		return -1;
+	}
+};
+
+GLStateCache GLState;
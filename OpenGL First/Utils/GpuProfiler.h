@@ -0,0 +1,297 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+//Frames whose queries may still be in flight, results of a frame are read when its slot comes around again
+const unsigned int GPU_PROFILER_LATENCY = 4;
+//Frames kept for averages, percentiles and CSV export
+const unsigned int GPU_PROFILER_HISTORY = 300;
+//Pass spanning the whole frame, from BeginFrame to EndFrame
+const char* const GPU_PROFILER_FRAME_PASS = "Frame";
+
+//GPU time of one pass over the kept frames, in milliseconds. Frames the pass wasn't drawn in are left out.
+struct GpuPassStatistics
+{
+	std::string name;
+	unsigned int samples = 0;
+	float average = 0.0f;
+	float median = 0.0f;
+	float p95 = 0.0f;
+	float p99 = 0.0f;
+	float max = 0.0f;
+};
+
+//GPU time of named passes measured with GL_TIMESTAMP queries. Every pass takes a timestamp at Begin and at End,
+//so passes can nest. Queries of a frame are read GPU_PROFILER_LATENCY frames later, when they are done; a frame
+//whose results still aren't available then is dropped instead of stalling the pipeline.
+//A pass begun several times in a frame is measured as the sum of its intervals.
+class GpuProfiler
+{
+public:
+	~GpuProfiler()
+	{
+		for (unsigned int i = 0; i < GPU_PROFILER_LATENCY; i++)
+		{
+			if (!frames[i].queries.empty())
+				glDeleteQueries(frames[i].queries.size(), frames[i].queries.data());
+		}
+	}
+
+	//Takes effect with the next BeginFrame, so passes are never left half measured
+	void SetEnabled(bool profilerEnabled)
+	{
+		enabled = profilerEnabled;
+	}
+
+	bool IsEnabled() const
+	{
+		return enabled;
+	}
+
+	//Reads the results of the frame whose queries are reused and starts the frame pass
+	void BeginFrame()
+	{
+		active = enabled;
+		if (!active)
+			return;
+
+		current = frame_number % GPU_PROFILER_LATENCY;
+		FrameQueries& frame = frames[current];
+		collect(frame);
+		frame.number = frame_number++;
+		frame.used = 0;
+		frame.intervals.clear();
+		open_intervals.clear();
+		Begin(GPU_PROFILER_FRAME_PASS);
+	}
+
+	void EndFrame()
+	{
+		if (!active)
+			return;
+		while (!open_intervals.empty())
+			End();
+	}
+
+	//Names are compared by contents, string literals are expected
+	void Begin(const char* name)
+	{
+		if (!active)
+			return;
+		FrameQueries& frame = frames[current];
+		Interval interval;
+		interval.pass = passIndex(name);
+		interval.begin = timestamp(frame);
+		interval.end = interval.begin;
+		open_intervals.push_back(frame.intervals.size());
+		frame.intervals.push_back(interval);
+	}
+
+	void End()
+	{
+		if (!active || open_intervals.empty())
+			return;
+		FrameQueries& frame = frames[current];
+		frame.intervals[open_intervals.back()].end = timestamp(frame);
+		open_intervals.pop_back();
+	}
+
+	//Forgets the kept frames, passes stay registered
+	void Reset()
+	{
+		history.clear();
+		history_next = 0;
+		dropped_frames = 0;
+	}
+
+	unsigned int GetFramesCount() const
+	{
+		return history.size();
+	}
+
+	unsigned int GetDroppedFramesCount() const
+	{
+		return dropped_frames;
+	}
+
+	//Statistics of every pass in the order passes were first begun
+	std::vector<GpuPassStatistics> GetPassStatistics() const
+	{
+		std::vector<GpuPassStatistics> statistics(passes.size());
+		std::vector<float> times;
+		for (unsigned int pass = 0; pass < passes.size(); pass++)
+		{
+			times.clear();
+			for (unsigned int i = 0; i < history.size(); i++)
+			{
+				if (pass < history[i].times.size() && history[i].times[pass] >= 0.0f)
+					times.push_back(history[i].times[pass]);
+			}
+
+			GpuPassStatistics& passStatistics = statistics[pass];
+			passStatistics.name = passes[pass];
+			passStatistics.samples = times.size();
+			if (times.empty())
+				continue;
+			std::sort(times.begin(), times.end());
+			double sum = 0.0;
+			for (unsigned int i = 0; i < times.size(); i++)
+				sum += times[i];
+			passStatistics.average = sum / times.size();
+			passStatistics.median = percentile(times, 0.5f);
+			passStatistics.p95 = percentile(times, 0.95f);
+			passStatistics.p99 = percentile(times, 0.99f);
+			passStatistics.max = times.back();
+		}
+		return statistics;
+	}
+
+	//Writes a row of pass times in milliseconds for every kept frame, oldest first. Cells of passes not drawn are empty.
+	bool WriteCsv(const std::string& path) const
+	{
+		std::ofstream csvFile;
+		csvFile.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+		try
+		{
+			csvFile.open(path);
+			csvFile << "frame";
+			for (unsigned int pass = 0; pass < passes.size(); pass++)
+				csvFile << "," << passes[pass];
+			csvFile << std::endl;
+
+			unsigned int oldest = history.size() < GPU_PROFILER_HISTORY ? 0 : history_next;
+			for (unsigned int i = 0; i < history.size(); i++)
+			{
+				const FrameTimes& frame = history[(oldest + i) % history.size()];
+				csvFile << frame.number;
+				for (unsigned int pass = 0; pass < passes.size(); pass++)
+				{
+					csvFile << ",";
+					if (pass < frame.times.size() && frame.times[pass] >= 0.0f)
+						csvFile << frame.times[pass];
+				}
+				csvFile << std::endl;
+			}
+			csvFile.close();
+		}
+		catch (const std::ofstream::failure&)
+		{
+			std::cout << "ERROR::PROFILER::FILE_NOT_SUCCESFULLY_SAVED" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	//Indices of the timestamps of a pass in the queries of its frame
+	struct Interval
+	{
+		unsigned int pass;
+		unsigned int begin;
+		unsigned int end;
+	};
+
+	struct FrameQueries
+	{
+		uint64_t number = 0;
+		// Queries are generated on demand and reused by every frame of the slot
+		std::vector<GLuint> queries;
+		unsigned int used = 0;
+		std::vector<Interval> intervals;
+	};
+
+	//Milliseconds of every pass in one frame, negative for passes not drawn
+	struct FrameTimes
+	{
+		uint64_t number;
+		std::vector<float> times;
+	};
+
+	bool enabled = false;
+	bool active = false;
+	uint64_t frame_number = 0;
+	unsigned int current = 0;
+	FrameQueries frames[GPU_PROFILER_LATENCY];
+	// Intervals of the current frame begun and not ended yet, innermost last
+	std::vector<unsigned int> open_intervals;
+	std::vector<std::string> passes;
+	// Ring of the last GPU_PROFILER_HISTORY frames, history_next is overwritten next
+	std::vector<FrameTimes> history;
+	unsigned int history_next = 0;
+	unsigned int dropped_frames = 0;
+
+	unsigned int passIndex(const char* name)
+	{
+		for (unsigned int i = 0; i < passes.size(); i++)
+		{
+			if (std::strcmp(passes[i].c_str(), name) == 0)
+				return i;
+		}
+		passes.push_back(name);
+		return passes.size() - 1;
+	}
+
+	unsigned int timestamp(FrameQueries& frame)
+	{
+		if (frame.used == frame.queries.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			frame.queries.push_back(query);
+		}
+		glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+		return frame.used++;
+	}
+
+	//Adds the frame to the history when its queries are done. Timestamps complete in order, so checking the last one is enough.
+	void collect(const FrameQueries& frame)
+	{
+		if (frame.used == 0)
+			return;
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			dropped_frames++;
+			return;
+		}
+
+		FrameTimes times;
+		times.number = frame.number;
+		times.times.assign(passes.size(), -1.0f);
+		for (unsigned int i = 0; i < frame.intervals.size(); i++)
+		{
+			const Interval& interval = frame.intervals[i];
+			if (interval.end == interval.begin)
+				continue;
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(frame.queries[interval.begin], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[interval.end], GL_QUERY_RESULT, &end);
+			float& time = times.times[interval.pass];
+			time = std::max(time, 0.0f) + (end > begin ? (end - begin) / 1.0e6f : 0.0f);
+		}
+
+		if (history.size() < GPU_PROFILER_HISTORY)
+			history.push_back(times);
+		else
+			history[history_next] = times;
+		history_next = (history_next + 1) % GPU_PROFILER_HISTORY;
+	}
+
+	//Nearest rank percentile of sorted times
+	static float percentile(const std::vector<float>& sortedTimes, float fraction)
+	{
+		unsigned int rank = (unsigned int)(fraction * (sortedTimes.size() - 1) + 0.5f);
+		return sortedTimes[std::min(rank, (unsigned int)sortedTimes.size() - 1)];
+	}
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+
+#include "utils/BoundsUtils.h"
+#include "utils/FrustumUtils.h"
+
+//Levels of detail per part, including the full part as level 0
+const unsigned int MAX_LODS = 6;
+//Every level targets this fraction of the previous level triangles
+const float LOD_REDUCTION = 0.5f;
+//Parts with fewer triangles are not simplified further
+const unsigned int LOD_MIN_TRIANGLES = 64;
+//Collapses moving the surface more than this fraction of the part bounds diagonal are never done
+const float LOD_MAX_RELATIVE_ERROR = 0.05f;
+//Default budget of projected simplification error in pixels
+const float DEFAULT_LOD_PIXEL_ERROR = 1.0f;
+
+//Index ranges of the levels of detail of one part in the shared index buffer, level 0 is the full part.
+//Errors are in world units and grow with the level.
+struct PartLods
+{
+	unsigned int count;
+	unsigned int indicesOffsets[MAX_LODS];
+	unsigned int indicesCounts[MAX_LODS];
+	float errors[MAX_LODS];
+};
+
+//Pixels one world unit anywhere in the bounds may cover in a view viewportHeight pixels high. Perspective views take
+//the scale at the nearest depth of the box, boxes crossing the camera plane get FLT_MAX.
+inline float GetPixelsPerUnit(const BoundingBox& bounds, const CullingView& view, float viewportHeight)
+{
+	float pixelsPerUnit = view.projectionScale * viewportHeight * 0.5f;
+	if (view.orthographic)
+		return pixelsPerUnit;
+
+	glm::vec3 center = bounds.Center();
+	glm::vec3 extent = bounds.Size() * 0.5f;
+	float nearestDepth = glm::dot(center - view.cameraPosition, view.viewDirection) - glm::dot(extent, glm::abs(view.viewDirection));
+	return nearestDepth > 0.0f ? pixelsPerUnit / nearestDepth : FLT_MAX;
+}
+
+//Coarsest level whose error projects to at most pixelError pixels anywhere in the part bounds,
+//parts crossing the camera plane always get level 0
+inline unsigned int SelectLod(const PartLods& lods, const BoundingBox& bounds, const CullingView& view, float pixelError)
+{
+	if (lods.count <= 1 || view.viewportHeight <= 0.0f || bounds.IsEmpty())
+		return 0;
+
+	float pixelsPerUnit = GetPixelsPerUnit(bounds, view, view.viewportHeight);
+	if (pixelsPerUnit == FLT_MAX)
+		return 0;
+
+	unsigned int level = 0;
+	while (level + 1 < lods.count && lods.errors[level + 1] * pixelsPerUnit <= pixelError)
+		level++;
+	return level;
+}
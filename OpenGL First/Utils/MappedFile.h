@@ -0,0 +1,129 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+
+//Read-only view of a whole file mapped into memory
+class MappedFile
+{
+public:
+
+	MappedFile(const char* path) : data(NULL), size(0)
+	{
+#ifdef _WIN32
+		fileHandle = INVALID_HANDLE_VALUE;
+		mappingHandle = NULL;
+
+		fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+			return;
+
+		mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle == NULL)
+			return;
+
+		data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if (data != NULL)
+			size = (size_t)fileSize.QuadPart;
+#else
+		fileDescriptor = open(path, O_RDONLY);
+		if (fileDescriptor < 0)
+			return;
+
+		struct stat fileStat;
+		if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+			return;
+
+		void* mapped = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapped == MAP_FAILED)
+			return;
+
+		madvise(mapped, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+		data = (const char*)mapped;
+		size = (size_t)fileStat.st_size;
+#endif
+	}
+
+	~MappedFile()
+	{
+		Dispose();
+	}
+
+	bool IsOpen() const
+	{
+		return data != NULL;
+	}
+
+	const char* Data() const
+	{
+		return data;
+	}
+
+	const char* End() const
+	{
+		return data + size;
+	}
+
+	size_t Size() const
+	{
+		return size;
+	}
+
+	// Unmaps the view and closes the file handles
+	void Dispose()
+	{
+#ifdef _WIN32
+		if (data != NULL)
+			UnmapViewOfFile(data);
+		if (mappingHandle != NULL)
+			CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+
+		mappingHandle = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (data != NULL)
+			munmap((void*)data, size);
+		if (fileDescriptor >= 0)
+			close(fileDescriptor);
+
+		fileDescriptor = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+private:
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* data;
+	size_t size;
+
+#ifdef _WIN32
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
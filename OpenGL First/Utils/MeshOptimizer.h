@@ -0,0 +1,313 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+//Triangle and vertex reordering for post-transform vertex cache, overdraw and vertex fetch locality
+//--------------------------------------------------------------------------------------------------
+
+//Size of the simulated FIFO post-transform cache
+const unsigned int VERTEX_CACHE_SIZE = 16;
+//Overdraw ordering may make ACMR at most this many times worse
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+//Transformed vertices per triangle (ACMR, 0.5 at best, 3 at worst) and per referenced vertex (ATVR, 1 at best)
+struct VertexCacheStatistics
+{
+	float acmr;
+	float atvr;
+
+	VertexCacheStatistics() : acmr(0.0f), atvr(0.0f) {}
+};
+
+//Lowest and highest referenced vertex, optimizers work on this range only so a part doesn't pay for the whole scene
+inline void indicesRange(const unsigned int* indices, unsigned int indicesCount, unsigned int& minVertex, unsigned int& maxVertex)
+{
+	minVertex = indicesCount > 0 ? indices[0] : 0;
+	maxVertex = minVertex;
+	for (unsigned int i = 1; i < indicesCount; i++)
+	{
+		minVertex = std::min(minVertex, indices[i]);
+		maxVertex = std::max(maxVertex, indices[i]);
+	}
+}
+
+//Simulates FIFO cache over the triangles in draw order
+inline VertexCacheStatistics AnalyzeVertexCache(const unsigned int* indices, unsigned int indicesCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	VertexCacheStatistics statistics;
+	if (indicesCount < 3)
+		return statistics;
+
+	unsigned int minVertex, maxVertex;
+	indicesRange(indices, indicesCount, minVertex, maxVertex);
+
+	// Vertex is in cache while fewer than cacheSize misses happened since its own miss
+	std::vector<unsigned int> cacheTimes(maxVertex - minVertex + 1, 0);
+	unsigned int time = cacheSize + 1;
+	unsigned int misses = 0;
+	unsigned int usedVertices = 0;
+	for (unsigned int i = 0; i < indicesCount; i++)
+	{
+		unsigned int vertex = indices[i] - minVertex;
+		if (cacheTimes[vertex] == 0)
+			usedVertices++;
+		if (time - cacheTimes[vertex] > cacheSize)
+		{
+			cacheTimes[vertex] = time++;
+			misses++;
+		}
+	}
+
+	statistics.acmr = (float)misses / (indicesCount / 3);
+	statistics.atvr = (float)misses / usedVertices;
+	return statistics;
+}
+
+//Reorders triangles for the post-transform cache with Tipsify (Sander et al. 2007) in linear time. Triangles are fanned
+//around a vertex, the next one is the fanned vertex that stays in cache longest, when there is none a recently used vertex
+//with triangles left is taken. Jumps to a vertex already out of cache start a new cluster, first triangles of clusters
+//are returned for OptimizeOverdraw.
+inline std::vector<unsigned int> OptimizeVertexCache(unsigned int* indices, unsigned int indicesCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	std::vector<unsigned int> clusters;
+	unsigned int trianglesCount = indicesCount / 3;
+	indicesCount = trianglesCount * 3;
+	if (trianglesCount == 0)
+		return clusters;
+
+	unsigned int minVertex, maxVertex;
+	indicesRange(indices, indicesCount, minVertex, maxVertex);
+	unsigned int verticesCount = maxVertex - minVertex + 1;
+
+	// Triangles of every vertex by counting sort, live count is the number of its triangles not emitted yet
+	std::vector<unsigned int> liveTriangles(verticesCount, 0);
+	for (unsigned int i = 0; i < indicesCount; i++)
+		liveTriangles[indices[i] - minVertex]++;
+
+	std::vector<unsigned int> adjacencyOffsets(verticesCount + 1, 0);
+	for (unsigned int i = 0; i < verticesCount; i++)
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+
+	std::vector<unsigned int> adjacency(indicesCount);
+	{
+		std::vector<unsigned int> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (unsigned int i = 0; i < indicesCount; i++)
+			adjacency[fillOffsets[indices[i] - minVertex]++] = i / 3;
+	}
+
+	std::vector<unsigned int> cacheTimes(verticesCount, 0);
+	std::vector<char> emitted(trianglesCount, 0);
+	std::vector<unsigned int> deadEnds;
+	deadEnds.reserve(indicesCount);
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indicesCount);
+
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 0;
+	int fanning = 0;
+	clusters.push_back(0);
+
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (unsigned int a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int vertex = indices[triangle * 3 + k] - minVertex;
+				output.push_back(vertex + minVertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - cacheTimes[vertex] > cacheSize)
+					cacheTimes[vertex] = time++;
+			}
+			emitted[triangle] = 1;
+		}
+
+		// Oldest candidate that is still in cache after its own triangles (at most 2 new vertices each) are emitted
+		int next = -1;
+		int bestPriority = -1;
+		for (unsigned int c = 0; c < candidates.size(); c++)
+		{
+			unsigned int vertex = candidates[c];
+			if (liveTriangles[vertex] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+				priority = time - cacheTimes[vertex];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		if (next < 0)
+		{
+			while (next < 0 && !deadEnds.empty())
+			{
+				unsigned int vertex = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[vertex] > 0)
+					next = vertex;
+			}
+			while (next < 0 && cursor < verticesCount)
+			{
+				if (liveTriangles[cursor] > 0)
+					next = cursor;
+				else
+					cursor++;
+			}
+			if (next >= 0 && time - cacheTimes[next] > cacheSize && output.size() / 3 != clusters.back())
+				clusters.push_back(output.size() / 3);
+		}
+
+		fanning = next;
+	}
+
+	memcpy(indices, output.data(), indicesCount * sizeof(unsigned int));
+	return clusters;
+}
+
+//Draws clusters of cache optimized triangles that face away from the mesh center first, so they occlude the rest
+//(Sander et al. 2007). Clusters are first split where their running ACMR drops to threshold times the ACMR of the
+//whole cluster. Cluster direction is the sum of its vertices normals, without normals face normals are used.
+//If the new order still costs more than threshold times the input ACMR, the input order is kept.
+inline void OptimizeOverdraw(unsigned int* indices, unsigned int indicesCount, const std::vector<unsigned int>& clusters, const float* vertices, const float* normals, const glm::vec3& center, float threshold = OVERDRAW_THRESHOLD, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	unsigned int trianglesCount = indicesCount / 3;
+	if (trianglesCount == 0 || clusters.empty())
+		return;
+
+	float inputAcmr = AnalyzeVertexCache(indices, trianglesCount * 3, cacheSize).acmr;
+	unsigned int minVertex, maxVertex;
+	indicesRange(indices, trianglesCount * 3, minVertex, maxVertex);
+
+	// Soft boundaries, cache is flushed at every cluster start since clusters end up in any order
+	std::vector<unsigned int> splitClusters;
+	std::vector<unsigned int> cacheTimes(maxVertex - minVertex + 1, 0);
+	unsigned int time = cacheSize + 1;
+	auto triangleMisses = [&](unsigned int triangle)
+	{
+		unsigned int misses = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int vertex = indices[triangle * 3 + k] - minVertex;
+			if (time - cacheTimes[vertex] > cacheSize)
+			{
+				cacheTimes[vertex] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	};
+
+	for (unsigned int c = 0; c < clusters.size(); c++)
+	{
+		unsigned int clusterEnd = c + 1 < clusters.size() ? clusters[c + 1] : trianglesCount;
+		unsigned int clusterMisses = 0;
+		time += cacheSize + 1;
+		for (unsigned int t = clusters[c]; t < clusterEnd; t++)
+			clusterMisses += triangleMisses(t);
+		float splitAcmr = threshold * clusterMisses / (clusterEnd - clusters[c]);
+
+		unsigned int misses = 0;
+		unsigned int splitStart = clusters[c];
+		splitClusters.push_back(splitStart);
+		time += cacheSize + 1;
+		for (unsigned int t = clusters[c]; t < clusterEnd; t++)
+		{
+			misses += triangleMisses(t);
+			if (t + 1 < clusterEnd && misses <= splitAcmr * (t + 1 - splitStart))
+			{
+				splitStart = t + 1;
+				splitClusters.push_back(splitStart);
+				misses = 0;
+				time += cacheSize + 1;
+			}
+		}
+	}
+
+	std::vector<float> sortKeys(splitClusters.size());
+	for (unsigned int c = 0; c < splitClusters.size(); c++)
+	{
+		unsigned int clusterEnd = c + 1 < splitClusters.size() ? splitClusters[c + 1] : trianglesCount;
+		glm::vec3 centroid(0.0f);
+		glm::vec3 direction(0.0f);
+		for (unsigned int t = splitClusters[c]; t < clusterEnd; t++)
+		{
+			glm::vec3 v[3];
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				const float* vertex = vertices + (size_t)indices[t * 3 + k] * 3;
+				v[k] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+				centroid += v[k];
+				if (normals != NULL)
+				{
+					const float* normal = normals + (size_t)indices[t * 3 + k] * 3;
+					direction += glm::vec3(normal[0], normal[1], normal[2]);
+				}
+			}
+			if (normals == NULL)
+				direction += glm::cross(v[1] - v[0], v[2] - v[0]);
+		}
+
+		centroid /= (float)((clusterEnd - splitClusters[c]) * 3);
+		float length = glm::length(direction);
+		sortKeys[c] = length > 0.0f ? glm::dot(centroid - center, direction / length) : 0.0f;
+	}
+
+	std::vector<unsigned int> order(splitClusters.size());
+	for (unsigned int c = 0; c < order.size(); c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<unsigned int> output;
+	output.reserve(trianglesCount * 3);
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		unsigned int c = order[i];
+		unsigned int clusterEnd = c + 1 < splitClusters.size() ? splitClusters[c + 1] : trianglesCount;
+		output.insert(output.end(), indices + splitClusters[c] * 3, indices + clusterEnd * 3);
+	}
+
+	if (AnalyzeVertexCache(output.data(), output.size(), cacheSize).acmr <= threshold * inputAcmr)
+		memcpy(indices, output.data(), output.size() * sizeof(unsigned int));
+}
+
+//Renumbers vertices in order of their first use by the indices and rewrites the indices. Returns new number of every
+//old vertex, unused vertices keep their order after the used ones. Returns empty table if an index is out of range.
+inline std::vector<unsigned int> OptimizeVertexFetch(unsigned int* indices, unsigned int indicesCount, unsigned int verticesCount)
+{
+	const unsigned int UNUSED = 0xFFFFFFFF;
+	std::vector<unsigned int> remap(verticesCount, UNUSED);
+	for (unsigned int i = 0; i < indicesCount; i++)
+	{
+		if (indices[i] >= verticesCount)
+			return std::vector<unsigned int>();
+	}
+
+	unsigned int nextVertex = 0;
+	for (unsigned int i = 0; i < indicesCount; i++)
+	{
+		if (remap[indices[i]] == UNUSED)
+			remap[indices[i]] = nextVertex++;
+		indices[i] = remap[indices[i]];
+	}
+	for (unsigned int i = 0; i < verticesCount; i++)
+	{
+		if (remap[i] == UNUSED)
+			remap[i] = nextVertex++;
+	}
+	return remap;
+}
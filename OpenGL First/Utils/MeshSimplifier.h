@@ -0,0 +1,319 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+//Quadric error simplification (Garland-Heckbert) by collapsing edges onto existing vertices, so simplified
+//triangles keep indexing the original vertex array
+//--------------------------------------------------------------------------------------------------
+
+//Sum of area weighted squared distances to planes, symmetric 4x4 matrix stored as its upper triangle
+struct Quadric
+{
+	double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	double weight;
+
+	Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), weight(0) {}
+
+	void AddPlane(double nx, double ny, double nz, double d, double planeWeight)
+	{
+		a00 += planeWeight * nx * nx; a01 += planeWeight * nx * ny; a02 += planeWeight * nx * nz; a03 += planeWeight * nx * d;
+		a11 += planeWeight * ny * ny; a12 += planeWeight * ny * nz; a13 += planeWeight * ny * d;
+		a22 += planeWeight * nz * nz; a23 += planeWeight * nz * d;
+		a33 += planeWeight * d * d;
+		weight += planeWeight;
+	}
+
+	void Add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+		weight += q.weight;
+	}
+
+	double Evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a00 * x * x + 2.0 * (a01 * x * y + a02 * x * z + a03 * x) + a11 * y * y + 2.0 * (a12 * y * z + a13 * y) +
+			a22 * z * z + 2.0 * a23 * z + a33;
+	}
+};
+
+//Triangles of one simplification level and its error, the area weighted RMS distance of the worst collapse so far
+struct SimplifiedLevel
+{
+	std::vector<unsigned int> indices;
+	float error;
+};
+
+//Collapse of canonical vertex into its neighbour
+struct EdgeCollapse
+{
+	unsigned int from;
+	unsigned int to;
+	float cost;
+};
+
+//Collapses edges cheapest first in passes of independent collapses and records a level every time the triangle count
+//drops to levelRatio of the previous level, until maxLevels are recorded, fewer than minTriangles are left or no
+//collapse under maxError is possible.
+//Vertices at the same position are collapsed together, a moved corner takes the copy of its new position whose normal
+//is closest to its own. Vertices on open or non-manifold edges never move, so parts keep their outline and
+//neighbouring parts stay closed.
+inline void SimplifyToLevels(std::vector<SimplifiedLevel>& levels, const unsigned int* indices, unsigned int indicesCount, const float* vertices, const float* normals,
+	unsigned int maxLevels, float levelRatio, unsigned int minTriangles, float maxError)
+{
+	levels.clear();
+	unsigned int trianglesCount = indicesCount / 3;
+	if (trianglesCount == 0 || maxLevels == 0)
+		return;
+
+	// Used vertices welded by exact position into canonical vertices
+	std::vector<unsigned int> usedVertices(indices, indices + trianglesCount * 3);
+	std::sort(usedVertices.begin(), usedVertices.end());
+	usedVertices.erase(std::unique(usedVertices.begin(), usedVertices.end()), usedVertices.end());
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+	struct PositionEqual
+	{
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+	std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> canonicalByPosition;
+	canonicalByPosition.reserve(usedVertices.size());
+	std::vector<unsigned int> usedCanonical(usedVertices.size());
+	std::vector<glm::vec3> positions;
+	for (unsigned int i = 0; i < usedVertices.size(); i++)
+	{
+		const float* vertex = vertices + (size_t)usedVertices[i] * 3;
+		glm::vec3 position(vertex[0], vertex[1], vertex[2]);
+		auto inserted = canonicalByPosition.insert(std::make_pair(position, (unsigned int)positions.size()));
+		if (inserted.second)
+			positions.push_back(position);
+		usedCanonical[i] = inserted.first->second;
+	}
+	unsigned int canonicalCount = positions.size();
+
+	// Copies of every canonical vertex as counting sorted lists
+	std::vector<unsigned int> copiesOffsets(canonicalCount + 1, 0);
+	for (unsigned int i = 0; i < usedVertices.size(); i++)
+		copiesOffsets[usedCanonical[i] + 1]++;
+	for (unsigned int i = 0; i < canonicalCount; i++)
+		copiesOffsets[i + 1] += copiesOffsets[i];
+	std::vector<unsigned int> copies(usedVertices.size());
+	std::vector<unsigned int> copiesFill(copiesOffsets.begin(), copiesOffsets.end() - 1);
+	for (unsigned int i = 0; i < usedVertices.size(); i++)
+		copies[copiesFill[usedCanonical[i]]++] = usedVertices[i];
+
+	std::vector<unsigned int> triangles(trianglesCount * 3);
+	std::vector<unsigned int> corners(indices, indices + trianglesCount * 3);
+	for (unsigned int i = 0; i < trianglesCount * 3; i++)
+		triangles[i] = usedCanonical[std::lower_bound(usedVertices.begin(), usedVertices.end(), indices[i]) - usedVertices.begin()];
+
+	std::vector<Quadric> quadrics(canonicalCount);
+	for (unsigned int t = 0; t < trianglesCount; t++)
+	{
+		const glm::vec3& p0 = positions[triangles[t * 3]];
+		glm::vec3 normal = glm::cross(positions[triangles[t * 3 + 1]] - p0, positions[triangles[t * 3 + 2]] - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+		normal /= length;
+		for (unsigned int k = 0; k < 3; k++)
+			quadrics[triangles[t * 3 + k]].AddPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0), length * 0.5f);
+	}
+
+	// Edges used by other than two triangles are open or non-manifold, their vertices are locked
+	std::vector<uint64_t> edges;
+	edges.reserve(trianglesCount * 3);
+	for (unsigned int t = 0; t < trianglesCount; t++)
+	{
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int a = triangles[t * 3 + k];
+			unsigned int b = triangles[t * 3 + (k + 1) % 3];
+			if (a != b)
+				edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::vector<uint8_t> locked(canonicalCount, 0);
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i;
+		while (j < edges.size() && edges[j] == edges[i])
+			j++;
+		if (j - i != 2)
+		{
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xFFFFFFFF] = 1;
+		}
+		i = j;
+	}
+	std::vector<uint64_t>().swap(edges);
+
+	auto cornerNormal = [&](unsigned int vertex)
+	{
+		return normals != NULL ? glm::vec3(normals[(size_t)vertex * 3], normals[(size_t)vertex * 3 + 1], normals[(size_t)vertex * 3 + 2]) : glm::vec3(0.0f);
+	};
+
+	float maxCost = 0.0f;
+	unsigned int levelTriangles = trianglesCount;
+	unsigned int targetTriangles = (unsigned int)(trianglesCount * levelRatio);
+	std::vector<unsigned int> adjacencyOffsets(canonicalCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> collapsedTo(canonicalCount);
+	std::vector<uint8_t> touched(canonicalCount);
+	std::vector<EdgeCollapse> collapses;
+
+	while (levels.size() < maxLevels && trianglesCount >= minTriangles)
+	{
+		// Triangles around every canonical vertex
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (unsigned int i = 0; i < trianglesCount * 3; i++)
+			adjacencyOffsets[triangles[i] + 1]++;
+		for (unsigned int i = 0; i < canonicalCount; i++)
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		adjacency.resize(trianglesCount * 3);
+		std::vector<unsigned int> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (unsigned int i = 0; i < trianglesCount * 3; i++)
+			adjacency[adjacencyFill[triangles[i]]++] = i / 3;
+
+		// Every interior edge is seen from both triangles, the one with the lower vertex first is taken
+		collapses.clear();
+		for (unsigned int i = 0; i < trianglesCount * 3; i++)
+		{
+			unsigned int a = triangles[i];
+			unsigned int b = triangles[i - i % 3 + (i + 1) % 3];
+			if (a >= b || (locked[a] && locked[b]))
+				continue;
+
+			Quadric q = quadrics[a];
+			q.Add(quadrics[b]);
+			double weight = std::max(q.weight, 1e-30);
+			double costAB = locked[a] ? DBL_MAX : q.Evaluate(positions[b]) / weight;
+			double costBA = locked[b] ? DBL_MAX : q.Evaluate(positions[a]) / weight;
+			EdgeCollapse collapse;
+			collapse.from = costAB <= costBA ? a : b;
+			collapse.to = costAB <= costBA ? b : a;
+			collapse.cost = (float)std::max(std::min(costAB, costBA), 0.0);
+			collapses.push_back(collapse);
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& x, const EdgeCollapse& y) { return x.cost < y.cost; });
+
+		// Independent collapses: the one-ring of a moved vertex stays still for the rest of the pass
+		std::fill(touched.begin(), touched.end(), 0);
+		for (unsigned int i = 0; i < canonicalCount; i++)
+			collapsedTo[i] = i;
+		unsigned int removedTriangles = 0;
+		unsigned int performed = 0;
+		for (size_t c = 0; c < collapses.size() && trianglesCount - removedTriangles > targetTriangles; c++)
+		{
+			const EdgeCollapse& collapse = collapses[c];
+			if (std::sqrt(collapse.cost) > maxError)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Triangles that stay must not flip or fold
+			bool flips = false;
+			unsigned int removed = 0;
+			for (unsigned int j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; j++)
+			{
+				const unsigned int* triangle = &triangles[adjacency[j] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removed++;
+					continue;
+				}
+				glm::vec3 p[3], moved[3];
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					p[k] = positions[triangle[k]];
+					moved[k] = triangle[k] == collapse.from ? positions[collapse.to] : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+			}
+			if (flips)
+				continue;
+
+			for (unsigned int j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+			{
+				for (unsigned int k = 0; k < 3; k++)
+					touched[triangles[adjacency[j] * 3 + k]] = 1;
+			}
+			collapsedTo[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			maxCost = std::max(maxCost, collapse.cost);
+			removedTriangles += removed;
+			performed++;
+		}
+
+		// Collapsed corners move to the best matching copy, triangles that lost an edge are dropped
+		unsigned int kept = 0;
+		for (unsigned int t = 0; t < trianglesCount; t++)
+		{
+			unsigned int moved[3];
+			for (unsigned int k = 0; k < 3; k++)
+				moved[k] = collapsedTo[triangles[t * 3 + k]];
+			if (moved[0] == moved[1] || moved[1] == moved[2] || moved[2] == moved[0])
+				continue;
+
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int corner = corners[t * 3 + k];
+				if (moved[k] != triangles[t * 3 + k])
+				{
+					glm::vec3 normal = cornerNormal(corner);
+					float bestDot = -FLT_MAX;
+					for (unsigned int j = copiesOffsets[moved[k]]; j < copiesOffsets[moved[k] + 1]; j++)
+					{
+						float d = glm::dot(normal, cornerNormal(copies[j]));
+						if (d > bestDot)
+						{
+							bestDot = d;
+							corner = copies[j];
+						}
+					}
+				}
+				triangles[kept * 3 + k] = moved[k];
+				corners[kept * 3 + k] = corner;
+			}
+			kept++;
+		}
+		trianglesCount = kept;
+
+		bool stalled = performed == 0;
+		if (trianglesCount <= targetTriangles || (stalled && trianglesCount < levelTriangles * (1.0f + levelRatio) * 0.5f))
+		{
+			SimplifiedLevel level;
+			level.indices.assign(corners.begin(), corners.begin() + trianglesCount * 3);
+			level.error = std::sqrt(maxCost);
+			levels.push_back(level);
+			levelTriangles = trianglesCount;
+			targetTriangles = (unsigned int)(trianglesCount * levelRatio);
+		}
+		if (stalled)
+			break;
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "utils/BoundsUtils.h"
+#include "utils/FrustumUtils.h"
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 128;
+
+//Run of consecutive triangles of one part in the drawn index buffer, with bounds for culling.
+//Every triangle faces away from a camera that sees coneApex at less than acos(coneCutoff) from coneAxis.
+struct Meshlet
+{
+	unsigned int part;
+	unsigned int indicesOffset;
+	unsigned int indicesCount;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	//Sine of the normal cone angle, above 1 when normals spread too much to ever cull the meshlet as backfacing
+	float coneCutoff;
+};
+
+//Result of culling one view
+struct CullingStatistics
+{
+	unsigned int parts = 0;
+	unsigned int visibleParts = 0;
+	unsigned int meshlets = 0;
+	unsigned int visibleMeshlets = 0;
+	unsigned int triangles = 0;
+	unsigned int frustumCulledTriangles = 0;
+	unsigned int backfaceCulledTriangles = 0;
+	unsigned int occludedParts = 0;
+	unsigned int occlusionCulledTriangles = 0;
+	//Triangles drawn into the occlusion buffer of the view
+	unsigned int occluderTriangles = 0;
+	//Triangles sent to draw, simplified levels of detail included
+	unsigned int drawnTriangles = 0;
+	//Visible parts drawn at a simplified level of detail
+	unsigned int lodParts = 0;
+};
+
+//Bounding sphere and normal cone of the meshlet triangles
+inline void computeMeshletBounds(Meshlet& meshlet, const unsigned int* indices, const float* vertices)
+{
+	const unsigned int* meshletIndices = indices + meshlet.indicesOffset;
+	BoundingBox box = ComputeTrianglesBounds(vertices, meshletIndices, NULL, meshlet.indicesCount / 3);
+	meshlet.center = box.Center();
+	meshlet.radius = 0.0f;
+
+	glm::vec3 axis(0.0f);
+	for (unsigned int i = 0; i < meshlet.indicesCount; i += 3)
+	{
+		glm::vec3 v[3];
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			const float* vertex = vertices + (size_t)meshletIndices[i + k] * 3;
+			v[k] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+			meshlet.radius = std::max(meshlet.radius, glm::length(v[k] - meshlet.center));
+		}
+		axis += glm::cross(v[1] - v[0], v[2] - v[0]);
+	}
+
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+	meshlet.coneCutoff = 2.0f;
+	float axisLength = glm::length(axis);
+	if (axisLength == 0.0f)
+		return;
+	axis /= axisLength;
+
+	// Narrowest cone around the area weighted normal that holds every face normal
+	float minDot = 1.0f;
+	for (unsigned int i = 0; i < meshlet.indicesCount; i += 3)
+	{
+		const float* v0 = vertices + (size_t)meshletIndices[i] * 3;
+		const float* v1 = vertices + (size_t)meshletIndices[i + 1] * 3;
+		const float* v2 = vertices + (size_t)meshletIndices[i + 2] * 3;
+		glm::vec3 p0(v0[0], v0[1], v0[2]);
+		glm::vec3 normal = glm::cross(glm::vec3(v1[0], v1[1], v1[2]) - p0, glm::vec3(v2[0], v2[1], v2[2]) - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+			minDot = std::min(minDot, glm::dot(normal / length, axis));
+	}
+	if (minDot <= 0.0f)
+		return;
+
+	// Apex is moved back along the axis until it lies behind every triangle plane
+	float apexDistance = 0.0f;
+	for (unsigned int i = 0; i < meshlet.indicesCount; i += 3)
+	{
+		const float* v0 = vertices + (size_t)meshletIndices[i] * 3;
+		const float* v1 = vertices + (size_t)meshletIndices[i + 1] * 3;
+		const float* v2 = vertices + (size_t)meshletIndices[i + 2] * 3;
+		glm::vec3 p0(v0[0], v0[1], v0[2]);
+		glm::vec3 normal = glm::cross(glm::vec3(v1[0], v1[1], v1[2]) - p0, glm::vec3(v2[0], v2[1], v2[2]) - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+		normal /= length;
+		apexDistance = std::max(apexDistance, glm::dot(normal, meshlet.center - p0) / glm::dot(normal, axis));
+	}
+
+	meshlet.coneApex = meshlet.center - axis * apexDistance;
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = glm::sqrt(1.0f - minDot * minDot);
+}
+
+//Splits triangles of the index range into meshlets in their current order, a meshlet ends when the next triangle
+//would exceed maxVertices or maxTriangles. Cache optimized order keeps meshlets compact.
+inline void BuildMeshlets(std::vector<Meshlet>& meshlets, const unsigned int* indices, unsigned int indicesOffset, unsigned int indicesCount, unsigned int part, const float* vertices,
+	unsigned int maxVertices = MESHLET_MAX_VERTICES, unsigned int maxTriangles = MESHLET_MAX_TRIANGLES)
+{
+	std::vector<unsigned int> meshletVertices;
+	meshletVertices.reserve(maxVertices);
+	Meshlet meshlet;
+	meshlet.part = part;
+	meshlet.indicesOffset = indicesOffset;
+	meshlet.indicesCount = 0;
+
+	unsigned int indicesEnd = indicesOffset + indicesCount / 3 * 3;
+	for (unsigned int i = indicesOffset; i < indicesEnd; i += 3)
+	{
+		unsigned int newVertices = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			bool known = std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) != meshletVertices.end();
+			for (unsigned int j = 0; j < k && !known; j++)
+				known = indices[i + j] == indices[i + k];
+			newVertices += known ? 0 : 1;
+		}
+
+		if (meshletVertices.size() + newVertices > maxVertices || meshlet.indicesCount / 3 == maxTriangles)
+		{
+			computeMeshletBounds(meshlet, indices, vertices);
+			meshlets.push_back(meshlet);
+			meshletVertices.clear();
+			meshlet.indicesOffset = i;
+			meshlet.indicesCount = 0;
+		}
+
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) == meshletVertices.end())
+				meshletVertices.push_back(indices[i + k]);
+		}
+		meshlet.indicesCount += 3;
+	}
+
+	if (meshlet.indicesCount > 0)
+	{
+		computeMeshletBounds(meshlet, indices, vertices);
+		meshlets.push_back(meshlet);
+	}
+}
+
+//Whole meshlet faces away from the camera (perspective) or the view direction (orthographic)
+inline bool IsMeshletBackfacing(const Meshlet& meshlet, const CullingView& view)
+{
+	if (meshlet.coneCutoff > 1.0f)
+		return false;
+
+	glm::vec3 direction = view.orthographic ? view.viewDirection : meshlet.coneApex - view.cameraPosition;
+	float length = glm::length(direction);
+	return length > 0.0f && glm::dot(direction, meshlet.coneAxis) >= meshlet.coneCutoff * length;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "utils/ParallelUtils.h"
+
+//Normals generated for an indexed triangle mesh
+struct MeshNormals
+{
+	//One normal (3 floats) per output vertex
+	std::vector<float> normals;
+
+	//Filled only when hard edges split vertices: source vertex of every output vertex and remapped indices
+	std::vector<unsigned int> sourceVertices;
+	std::vector<unsigned int> indices;
+};
+
+const unsigned int NORMALS_CHUNK_SIZE = 16384;
+
+//Angle between two vectors given the length of their cross product (>= 0) and their dot product,
+//polynomial atan2 with error below 1e-5 radians which is plenty for weighting normals
+inline float vectorsAngle(float crossLength, float dot)
+{
+	const float PI = 3.14159265358979f;
+	float absDot = glm::abs(dot);
+	float maxValue = glm::max(crossLength, absDot);
+	if (maxValue == 0.0f)
+		return 0.0f;
+
+	float a = glm::min(crossLength, absDot) / maxValue;
+	float s = a * a;
+	float angle = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+	if (crossLength > absDot)
+		angle = PI * 0.5f - angle;
+	return dot < 0.0f ? PI - angle : angle;
+}
+
+inline glm::vec3 normalizeOrDefault(const glm::vec3& normal)
+{
+	float length = glm::length(normal);
+	return length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+//Angle weighted vertex normals in linear time. Face normals are computed per triangle, then every vertex
+//gathers its faces through a vertex -> corners table built with a counting sort. Each vertex is summed by
+//one thread in fixed corner order, so the result doesn't depend on the workers count.
+//Faces meeting at more than creaseAngle degrees don't smooth each other and vertices on such edges are split,
+//with creaseAngle >= 180 all vertices keep a single normal and are never split.
+inline MeshNormals CalculateNormals(const float* vertices, unsigned int verticesCount, const unsigned int* indices, unsigned int trianglesCount, float creaseAngle = 180.0f, unsigned int workers = 0)
+{
+	MeshNormals result;
+	unsigned int cornersCount = trianglesCount * 3;
+
+	// Unit face normals and angles of triangles at their corners
+	std::vector<glm::vec3> facesNormals(trianglesCount);
+	std::vector<float> cornersAngles(cornersCount);
+	unsigned int trianglesChunks = (trianglesCount + NORMALS_CHUNK_SIZE - 1) / NORMALS_CHUNK_SIZE;
+	ParallelFor(trianglesChunks, [&](unsigned int chunk)
+	{
+		unsigned int chunkEnd = std::min((chunk + 1) * NORMALS_CHUNK_SIZE, trianglesCount);
+		for (unsigned int i = chunk * NORMALS_CHUNK_SIZE; i < chunkEnd; i++)
+		{
+			glm::vec3 v[3];
+			bool valid = true;
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int index = indices[i * 3 + k];
+				valid = valid && index < verticesCount;
+				v[k] = valid ? glm::vec3(vertices[index * 3], vertices[index * 3 + 1], vertices[index * 3 + 2]) : glm::vec3(0.0f);
+			}
+
+			glm::vec3 cross = glm::cross(v[1] - v[0], v[2] - v[0]);
+			float crossLength = glm::length(cross);
+			if (!valid || crossLength == 0.0f)
+			{
+				facesNormals[i] = glm::vec3(0.0f);
+				cornersAngles[i * 3] = cornersAngles[i * 3 + 1] = cornersAngles[i * 3 + 2] = 0.0f;
+				continue;
+			}
+
+			facesNormals[i] = cross / crossLength;
+			// Length of the cross product is the same at every corner, so only the dot products differ
+			for (unsigned int k = 0; k < 3; k++)
+				cornersAngles[i * 3 + k] = vectorsAngle(crossLength, glm::dot(v[(k + 1) % 3] - v[k], v[(k + 2) % 3] - v[k]));
+		}
+	}, workers);
+
+	// Counting sort of corners by vertex, corners of each vertex stay in ascending order
+	std::vector<unsigned int> vertexCornersOffsets(verticesCount + 1, 0);
+	for (unsigned int i = 0; i < cornersCount; i++)
+	{
+		if (indices[i] < verticesCount)
+			vertexCornersOffsets[indices[i] + 1]++;
+	}
+	for (unsigned int i = 0; i < verticesCount; i++)
+		vertexCornersOffsets[i + 1] += vertexCornersOffsets[i];
+
+	std::vector<unsigned int> vertexCorners(vertexCornersOffsets[verticesCount]);
+	{
+		std::vector<unsigned int> fillOffsets(vertexCornersOffsets.begin(), vertexCornersOffsets.end() - 1);
+		for (unsigned int i = 0; i < cornersCount; i++)
+		{
+			if (indices[i] < verticesCount)
+				vertexCorners[fillOffsets[indices[i]]++] = i;
+		}
+	}
+
+	unsigned int verticesChunks = (verticesCount + NORMALS_CHUNK_SIZE - 1) / NORMALS_CHUNK_SIZE;
+	result.normals.resize(verticesCount * 3);
+
+	if (creaseAngle >= 180.0f)
+	{
+		ParallelFor(verticesChunks, [&](unsigned int chunk)
+		{
+			unsigned int chunkEnd = std::min((chunk + 1) * NORMALS_CHUNK_SIZE, verticesCount);
+			for (unsigned int v = chunk * NORMALS_CHUNK_SIZE; v < chunkEnd; v++)
+			{
+				glm::vec3 normal(0.0f);
+				for (unsigned int c = vertexCornersOffsets[v]; c < vertexCornersOffsets[v + 1]; c++)
+					normal += cornersAngles[vertexCorners[c]] * facesNormals[vertexCorners[c] / 3];
+
+				normal = normalizeOrDefault(normal);
+				result.normals[v * 3] = normal.x;
+				result.normals[v * 3 + 1] = normal.y;
+				result.normals[v * 3 + 2] = normal.z;
+			}
+		}, workers);
+		return result;
+	}
+
+	// Every corner sums only faces within the crease angle of its own face, corners of a vertex
+	// that ended with the same normal are grouped into one output vertex
+	float creaseCos = glm::cos(glm::radians(creaseAngle));
+	std::vector<glm::vec3> cornersNormals(cornersCount, glm::vec3(0.0f, 1.0f, 0.0f));
+	std::vector<unsigned int> cornersGroups(cornersCount, 0);
+	std::vector<unsigned int> groupsOffsets(verticesCount + 1, 0);
+
+	ParallelFor(verticesChunks, [&](unsigned int chunk)
+	{
+		unsigned int chunkEnd = std::min((chunk + 1) * NORMALS_CHUNK_SIZE, verticesCount);
+		for (unsigned int v = chunk * NORMALS_CHUNK_SIZE; v < chunkEnd; v++)
+		{
+			unsigned int first = vertexCornersOffsets[v];
+			unsigned int last = vertexCornersOffsets[v + 1];
+			unsigned int groupsCount = 0;
+
+			for (unsigned int c = first; c < last; c++)
+			{
+				unsigned int corner = vertexCorners[c];
+				glm::vec3 faceNormal = facesNormals[corner / 3];
+				bool degenerate = cornersAngles[corner] == 0.0f;
+
+				glm::vec3 normal(0.0f);
+				for (unsigned int n = first; n < last; n++)
+				{
+					unsigned int neighbour = vertexCorners[n];
+					if (degenerate || glm::dot(faceNormal, facesNormals[neighbour / 3]) >= creaseCos)
+						normal += cornersAngles[neighbour] * facesNormals[neighbour / 3];
+				}
+				normal = normalizeOrDefault(normal);
+				cornersNormals[corner] = normal;
+
+				unsigned int group = groupsCount;
+				for (unsigned int previous = first; previous < c; previous++)
+				{
+					if (cornersNormals[vertexCorners[previous]] == normal)
+					{
+						group = cornersGroups[vertexCorners[previous]];
+						break;
+					}
+				}
+				if (group == groupsCount)
+					groupsCount++;
+				cornersGroups[corner] = group;
+			}
+
+			groupsOffsets[v + 1] = groupsCount > 0 ? groupsCount : 1;
+		}
+	}, workers);
+
+	for (unsigned int i = 0; i < verticesCount; i++)
+		groupsOffsets[i + 1] += groupsOffsets[i];
+
+	unsigned int outputCount = groupsOffsets[verticesCount];
+	if (outputCount != verticesCount)
+	{
+		result.normals.resize(outputCount * 3);
+		result.sourceVertices.resize(outputCount);
+		result.indices.assign(indices, indices + cornersCount);
+	}
+
+	ParallelFor(verticesChunks, [&](unsigned int chunk)
+	{
+		unsigned int chunkEnd = std::min((chunk + 1) * NORMALS_CHUNK_SIZE, verticesCount);
+		for (unsigned int v = chunk * NORMALS_CHUNK_SIZE; v < chunkEnd; v++)
+		{
+			unsigned int base = groupsOffsets[v];
+			if (outputCount != verticesCount)
+			{
+				for (unsigned int i = base; i < groupsOffsets[v + 1]; i++)
+					result.sourceVertices[i] = v;
+			}
+
+			// Unused vertex keeps the default normal
+			result.normals[base * 3] = 0.0f;
+			result.normals[base * 3 + 1] = 1.0f;
+			result.normals[base * 3 + 2] = 0.0f;
+
+			for (unsigned int c = vertexCornersOffsets[v]; c < vertexCornersOffsets[v + 1]; c++)
+			{
+				unsigned int corner = vertexCorners[c];
+				unsigned int output = base + cornersGroups[corner];
+				result.normals[output * 3] = cornersNormals[corner].x;
+				result.normals[output * 3 + 1] = cornersNormals[corner].y;
+				result.normals[output * 3 + 2] = cornersNormals[corner].z;
+				if (outputCount != verticesCount)
+					result.indices[corner] = output;
+			}
+		}
+	}, workers);
+
+	return result;
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "utils/BoundsUtils.h"
+
+//Resolution of the occlusion depth buffer of one view
+const unsigned int OCCLUSION_WIDTH = 256;
+const unsigned int OCCLUSION_HEIGHT = 192;
+//Pixels per side of the tiles that keep the farthest depth they hold
+const unsigned int OCCLUSION_TILE_SIZE = 8;
+//Occluder triangles drawn per view, and at most per occluder part
+const unsigned int OCCLUSION_TRIANGLE_BUDGET = 32768;
+const unsigned int OCCLUDER_MAX_TRIANGLES = 4096;
+//Parts smaller than this many occlusion buffer pixels across hide too little to be drawn as occluders
+const float OCCLUDER_MIN_PIXELS = 4.0f;
+//Simplified occluders may move the surface by at most this many occlusion buffer pixels
+const float OCCLUDER_PIXEL_ERROR = 0.5f;
+//Parts tested against the buffers per parallel task
+const unsigned int OCCLUSION_CHUNK_SIZE = 256;
+//Boxes must be this far (in NDC depth) behind the buffer to be occluded, so no part hides behind itself
+const float OCCLUSION_DEPTH_BIAS = 1e-5f;
+
+//Depth only software rasterizer of occluders in one view. Depth is NDC z at pixel centers, the nearest of all
+//triangles covering the center. Tiles keep their farthest depth, so boxes behind whole tiles skip the pixels.
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer() : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT), tilesDepth(TILES_X * TILES_Y), drawnTriangles(0) {}
+
+	//Clears the buffer for occluders seen through viewProjection
+	void Begin(const glm::mat4& viewProjection)
+	{
+		transform = viewProjection;
+		std::fill(depth.begin(), depth.end(), FLT_MAX);
+		drawnTriangles = 0;
+	}
+
+	//Draws triangles of xyz vertices, both facings, clipped to the near plane
+	void DrawTriangles(const float* vertices, const unsigned int* indices, unsigned int indicesCount)
+	{
+		for (unsigned int i = 0; i + 2 < indicesCount; i += 3)
+		{
+			glm::vec4 clip[3];
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				const float* vertex = vertices + (size_t)indices[i + k] * 3;
+				clip[k] = transform * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+			}
+			drawTriangle(clip);
+		}
+	}
+
+	//Updates farthest depth of every tile, must follow the draws before testing boxes
+	void End()
+	{
+		for (unsigned int tileY = 0; tileY < TILES_Y; tileY++)
+		{
+			for (unsigned int tileX = 0; tileX < TILES_X; tileX++)
+			{
+				float farthest = 0.0f;
+				for (unsigned int y = tileY * OCCLUSION_TILE_SIZE; y < (tileY + 1) * OCCLUSION_TILE_SIZE; y++)
+				{
+					const float* row = depth.data() + y * OCCLUSION_WIDTH + tileX * OCCLUSION_TILE_SIZE;
+					for (unsigned int x = 0; x < OCCLUSION_TILE_SIZE; x++)
+						farthest = row[x] > farthest ? row[x] : farthest;
+				}
+				tilesDepth[tileY * TILES_X + tileX] = farthest;
+			}
+		}
+	}
+
+	//Box is behind the drawn depth at every pixel it may cover. Boxes reaching in front of the near plane are never occluded.
+	bool IsBoxOccluded(const BoundingBox& box) const
+	{
+		if (box.IsEmpty())
+			return false;
+
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+		for (unsigned int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+			glm::vec4 clip = transform * glm::vec4(point, 1.0f);
+			if (clip.w <= 0.0f || clip.z < -clip.w)
+				return false;
+
+			glm::vec3 screen = toScreen(clip);
+			minX = std::min(minX, screen.x);
+			maxX = std::max(maxX, screen.x);
+			minY = std::min(minY, screen.y);
+			maxY = std::max(maxY, screen.y);
+			nearest = std::min(nearest, screen.z);
+		}
+
+		// Parts of the box outside the view can't be seen anyway, the rest must be hidden
+		if (maxX < 0.0f || maxY < 0.0f || minX >= OCCLUSION_WIDTH || minY >= OCCLUSION_HEIGHT)
+			return false;
+
+		// Every pixel the box rectangle touches, not only the ones whose center it covers
+		unsigned int x0 = (unsigned int)std::max(minX, 0.0f), x1 = (unsigned int)std::min(maxX, OCCLUSION_WIDTH - 1.0f);
+		unsigned int y0 = (unsigned int)std::max(minY, 0.0f), y1 = (unsigned int)std::min(maxY, OCCLUSION_HEIGHT - 1.0f);
+		float limit = nearest - OCCLUSION_DEPTH_BIAS;
+		for (unsigned int tileY = y0 / OCCLUSION_TILE_SIZE; tileY <= y1 / OCCLUSION_TILE_SIZE; tileY++)
+		{
+			for (unsigned int tileX = x0 / OCCLUSION_TILE_SIZE; tileX <= x1 / OCCLUSION_TILE_SIZE; tileX++)
+			{
+				if (tilesDepth[tileY * TILES_X + tileX] <= limit)
+					continue;
+
+				unsigned int tileX1 = std::min(x1, (tileX + 1) * OCCLUSION_TILE_SIZE - 1);
+				unsigned int tileY1 = std::min(y1, (tileY + 1) * OCCLUSION_TILE_SIZE - 1);
+				for (unsigned int y = std::max(y0, tileY * OCCLUSION_TILE_SIZE); y <= tileY1; y++)
+				{
+					const float* row = depth.data() + y * OCCLUSION_WIDTH;
+					for (unsigned int x = std::max(x0, tileX * OCCLUSION_TILE_SIZE); x <= tileX1; x++)
+					{
+						if (row[x] > limit)
+							return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	//Triangles drawn since Begin, after clipping
+	unsigned int GetDrawnTriangles() const
+	{
+		return drawnTriangles;
+	}
+
+	//Row major depth, bottom row first, FLT_MAX where nothing was drawn
+	const float* GetDepth() const
+	{
+		return depth.data();
+	}
+
+private:
+	static const unsigned int TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE;
+	static const unsigned int TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE;
+
+	std::vector<float> depth;
+	std::vector<float> tilesDepth;
+	glm::mat4 transform;
+	unsigned int drawnTriangles;
+
+	static glm::vec3 toScreen(const glm::vec4& clip)
+	{
+		float inverseW = 1.0f / clip.w;
+		return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH, (clip.y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT, clip.z * inverseW);
+	}
+
+	//Clips the triangle against the near plane (z = -w) and rasterizes what remains
+	void drawTriangle(const glm::vec4* clip)
+	{
+		// Whole triangle outside one clip plane
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			if ((clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w) ||
+				(clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w))
+				return;
+		}
+
+		if (clip[0].z >= -clip[0].w && clip[1].z >= -clip[1].w && clip[2].z >= -clip[2].w)
+		{
+			rasterize(toScreen(clip[0]), toScreen(clip[1]), toScreen(clip[2]));
+			return;
+		}
+
+		glm::vec4 polygon[4];
+		unsigned int polygonCount = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			const glm::vec4& a = clip[k];
+			const glm::vec4& b = clip[(k + 1) % 3];
+			float distanceA = a.z + a.w;
+			float distanceB = b.z + b.w;
+			if (distanceA >= 0.0f)
+				polygon[polygonCount++] = a;
+			if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+				polygon[polygonCount++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+		}
+
+		for (unsigned int k = 2; k < polygonCount; k++)
+			rasterize(toScreen(polygon[0]), toScreen(polygon[k - 1]), toScreen(polygon[k]));
+	}
+
+	//Range [first, last) of pixels in [0, size) whose centers lie in [low, high], false when there are none
+	static bool pixelCenters(float low, float high, unsigned int size, unsigned int& first, unsigned int& last)
+	{
+		low = std::max(low - 0.5f, 0.0f);
+		high = std::min(high - 0.5f, size - 1.0f);
+		if (!(low <= high))
+			return false;
+
+		// Both are non negative here, so truncation rounds down
+		first = (unsigned int)low;
+		first += (float)first < low ? 1 : 0;
+		last = (unsigned int)high + 1;
+		return first < last;
+	}
+
+	//Half space rasterization over the triangle bounding rectangle. Edge functions and depth are affine in screen
+	//space, every pixel of a row is computed from the row start alone so the inner loop vectorizes.
+	void rasterize(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
+	{
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (!(std::fabs(area) > 0.0f))
+			return;
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		// Pixels whose centers lie in the bounding rectangle, small triangles often have none
+		unsigned int x0, x1, y0, y1;
+		if (!pixelCenters(std::min(v0.x, std::min(v1.x, v2.x)), std::max(v0.x, std::max(v1.x, v2.x)), OCCLUSION_WIDTH, x0, x1) ||
+			!pixelCenters(std::min(v0.y, std::min(v1.y, v2.y)), std::max(v0.y, std::max(v1.y, v2.y)), OCCLUSION_HEIGHT, y0, y1))
+			return;
+		float minX = (float)x0, minY = (float)y0;
+		drawnTriangles++;
+
+		// Edge k is positive on the side of vertex k, weights are barycentrics once divided by the area
+		const glm::vec3* vertices[3] = { &v0, &v1, &v2 };
+		float stepX[3], stepY[3], start[3];
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			const glm::vec3& a = *vertices[(k + 1) % 3];
+			const glm::vec3& b = *vertices[(k + 2) % 3];
+			stepX[k] = a.y - b.y;
+			stepY[k] = b.x - a.x;
+			start[k] = (minX + 0.5f - a.x) * stepX[k] + (minY + 0.5f - a.y) * stepY[k];
+		}
+
+		float inverseArea = 1.0f / area;
+		float depthStepX = (v0.z * stepX[0] + v1.z * stepX[1] + v2.z * stepX[2]) * inverseArea;
+		float depthStepY = (v0.z * stepY[0] + v1.z * stepY[1] + v2.z * stepY[2]) * inverseArea;
+		float depthStart = (v0.z * start[0] + v1.z * start[1] + v2.z * start[2]) * inverseArea;
+
+		float width = (float)(x1 - x0);
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			// Span of the row inside all edges, widened by a pixel as the exact test below decides coverage
+			float spanStart = 0.0f, spanEnd = width;
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				if (stepX[k] > 0.0f)
+					spanStart = std::max(spanStart, -start[k] / stepX[k] - 1.0f);
+				else if (stepX[k] < 0.0f)
+					spanEnd = std::min(spanEnd, start[k] / -stepX[k] + 2.0f);
+				else if (start[k] < 0.0f)
+					spanEnd = 0.0f;
+			}
+
+			float* row = depth.data() + y * OCCLUSION_WIDTH;
+			unsigned int spanX1 = spanEnd > spanStart ? x0 + (unsigned int)spanEnd : x0;
+			for (unsigned int x = x0 + (unsigned int)spanStart; x < spanX1; x++)
+			{
+				float offset = (float)(x - x0);
+				float edge0 = start[0] + stepX[0] * offset;
+				float edge1 = start[1] + stepX[1] * offset;
+				float edge2 = start[2] + stepX[2] * offset;
+				float pixelDepth = depthStart + depthStepX * offset;
+				bool inside = (edge0 >= 0.0f) & (edge1 >= 0.0f) & (edge2 >= 0.0f) & (pixelDepth < row[x]);
+				row[x] = inside ? pixelDepth : row[x];
+			}
+
+			for (unsigned int k = 0; k < 3; k++)
+				start[k] += stepY[k];
+			depthStart += depthStepY;
+		}
+	}
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//Number of threads worth running for CPU bound work
+inline unsigned int GetWorkerCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+//Runs task(i) for every i in [0, count). Items are handed out one by one to the workers,
+//the calling thread works too and returns when all items are done.
+template<typename Task>
+void ParallelFor(unsigned int count, const Task& task, unsigned int workers = 0)
+{
+	if (workers == 0)
+		workers = GetWorkerCount();
+	if (workers > count)
+		workers = count;
+
+	if (workers <= 1)
+	{
+		for (unsigned int i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+
+	std::atomic<unsigned int> nextItem(0);
+	auto worker = [&]()
+	{
+		for (unsigned int i = nextItem++; i < count; i = nextItem++)
+			task(i);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (unsigned int i = 1; i < workers; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
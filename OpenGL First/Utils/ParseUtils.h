@@ -0,0 +1,381 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//Non-allocating text tokenizing and locale-free number parsing used by scene loaders
+//--------------------------------------------------------------------------------------------------
+
+//View on a part of a text buffer, never owns its characters
+struct Token
+{
+	const char* begin;
+	const char* end;
+
+	Token() : begin(NULL), end(NULL) {}
+	Token(const char* tokenBegin, const char* tokenEnd) : begin(tokenBegin), end(tokenEnd) {}
+
+	size_t Length() const
+	{
+		return (size_t)(end - begin);
+	}
+
+	bool Empty() const
+	{
+		return begin == end;
+	}
+
+	bool Equals(const char* text, size_t length) const
+	{
+		return Length() == length && memcmp(begin, text, length) == 0;
+	}
+
+	bool Equals(const std::string& text) const
+	{
+		return Equals(text.c_str(), text.length());
+	}
+
+	bool StartsWith(const char* text, size_t length) const
+	{
+		return Length() >= length && memcmp(begin, text, length) == 0;
+	}
+
+	std::string ToString() const
+	{
+		return std::string(begin, end);
+	}
+};
+
+inline bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool IsDigit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+//Returns next line of the buffer (without the line break) and moves the cursor behind it
+inline bool NextLine(const char*& cursor, const char* end, Token& line)
+{
+	if (cursor >= end)
+		return false;
+
+	const char* lineEnd = (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+	if (lineEnd == NULL)
+		lineEnd = end;
+
+	line = Token(cursor, lineEnd);
+	cursor = lineEnd < end ? lineEnd + 1 : end;
+	return true;
+}
+
+//Returns next blank separated word of the range and moves the cursor behind it
+inline bool NextToken(const char*& cursor, const char* end, Token& token)
+{
+	while (cursor < end && IsBlank(*cursor))
+		cursor++;
+
+	if (cursor >= end)
+		return false;
+
+	const char* tokenBegin = cursor;
+	while (cursor < end && !IsBlank(*cursor))
+		cursor++;
+
+	token = Token(tokenBegin, cursor);
+	return true;
+}
+
+//Iterates words of a single line with look-ahead and lazily counted size
+class LineTokenizer
+{
+public:
+
+	LineTokenizer(const Token& line) : lineBegin(line.begin), cursor(line.begin), lineEnd(line.end), count(-1) {}
+
+	bool Next(Token& token)
+	{
+		return NextToken(cursor, lineEnd, token);
+	}
+
+	// Returns the word placed offset words after the last returned one (empty if there is none)
+	Token Peek(unsigned int offset) const
+	{
+		const char* peekCursor = cursor;
+		Token token(lineEnd, lineEnd);
+		for (unsigned int i = 0; i < offset; i++)
+		{
+			if (!NextToken(peekCursor, lineEnd, token))
+				return Token(lineEnd, lineEnd);
+		}
+		return token;
+	}
+
+	void Skip(unsigned int words)
+	{
+		Token token;
+		for (unsigned int i = 0; i < words && NextToken(cursor, lineEnd, token); i++);
+	}
+
+	Token First() const
+	{
+		const char* firstCursor = lineBegin;
+		Token token(lineEnd, lineEnd);
+		NextToken(firstCursor, lineEnd, token);
+		return token;
+	}
+
+	unsigned int Count()
+	{
+		if (count < 0)
+		{
+			const char* countCursor = lineBegin;
+			Token token;
+			count = 0;
+			while (NextToken(countCursor, lineEnd, token))
+				count++;
+		}
+		return (unsigned int)count;
+	}
+
+private:
+	const char* lineBegin;
+	const char* cursor;
+	const char* lineEnd;
+	int count;
+};
+
+//Returns next word of the range treating line breaks as blanks, for ranges where lines don't matter
+inline bool NextWord(const char*& cursor, const char* end, Token& token)
+{
+	while (cursor < end && (IsBlank(*cursor) || *cursor == '\n'))
+		cursor++;
+
+	if (cursor >= end)
+		return false;
+
+	const char* tokenBegin = cursor;
+	while (cursor < end && !IsBlank(*cursor) && *cursor != '\n')
+		cursor++;
+
+	token = Token(tokenBegin, cursor);
+	return true;
+}
+
+//Finds first occurrence of the word standing as a whole token, returns NULL if there is none
+inline const char* FindWord(const char* begin, const char* end, const std::string& word)
+{
+	size_t length = word.length();
+	const char* cursor = begin;
+	while ((size_t)(end - cursor) >= length)
+	{
+		const char* found = (const char*)memchr(cursor, word[0], (size_t)(end - cursor) - length + 1);
+		if (found == NULL)
+			return NULL;
+
+		bool wordStart = found == begin || IsBlank(found[-1]) || found[-1] == '\n';
+		bool wordEnd = found + length == end || IsBlank(found[length]) || found[length] == '\n';
+		if (wordStart && wordEnd && memcmp(found, word.c_str(), length) == 0)
+			return found;
+
+		cursor = found + 1;
+	}
+	return NULL;
+}
+
+//Returns beginning of the line containing position
+inline const char* FindLineStart(const char* begin, const char* position)
+{
+	while (position > begin && position[-1] != '\n')
+		position--;
+	return position;
+}
+
+//Splits range into at most chunksCount parts ending on line breaks, returns chunks boundaries
+inline std::vector<const char*> SplitAtLines(const char* begin, const char* end, unsigned int chunksCount)
+{
+	std::vector<const char*> boundaries;
+	boundaries.push_back(begin);
+
+	size_t chunkSize = (size_t)(end - begin) / (chunksCount > 0 ? chunksCount : 1) + 1;
+	const char* cursor = begin;
+	while (cursor < end)
+	{
+		const char* split = (size_t)(end - cursor) > chunkSize ? cursor + chunkSize : end;
+		if (split < end)
+		{
+			const char* lineEnd = (const char*)memchr(split, '\n', (size_t)(end - split));
+			split = lineEnd != NULL ? lineEnd + 1 : end;
+		}
+		boundaries.push_back(split);
+		cursor = split;
+	}
+
+	return boundaries;
+}
+
+//Number parsing
+//--------------------------------------------------------------------------------------------------
+
+//strtof on a copy of the token, used when the fast path can't guarantee the correctly rounded result
+inline float parseFloatFallback(const Token& token)
+{
+	char buffer[64];
+	size_t length = token.Length();
+	if (length < sizeof(buffer))
+	{
+		memcpy(buffer, token.begin, length);
+		buffer[length] = '\0';
+		return strtof(buffer, NULL);
+	}
+
+	return strtof(token.ToString().c_str(), NULL);
+}
+
+//Parses decimal float with the same result as std::stof, without locale lookups and allocations
+inline float ParseFloat(const Token& token)
+{
+	static const double POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	const char* c = token.begin;
+	const char* end = token.end;
+	bool negative = false;
+
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		negative = *c == '-';
+		c++;
+	}
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool anyDigit = false;
+
+	while (c < end && *c == '0')
+	{
+		anyDigit = true;
+		c++;
+	}
+	while (c < end && IsDigit(*c))
+	{
+		mantissa = mantissa * 10 + (unsigned long long)(*c - '0');
+		digits++;
+		anyDigit = true;
+		c++;
+	}
+	if (c < end && *c == '.')
+	{
+		c++;
+		if (mantissa == 0)
+		{
+			while (c < end && *c == '0')
+			{
+				exponent--;
+				anyDigit = true;
+				c++;
+			}
+		}
+		while (c < end && IsDigit(*c))
+		{
+			mantissa = mantissa * 10 + (unsigned long long)(*c - '0');
+			digits++;
+			exponent--;
+			anyDigit = true;
+			c++;
+		}
+	}
+	if (anyDigit && c < end && (*c == 'e' || *c == 'E'))
+	{
+		const char* exponentBegin = c++;
+		bool negativeExponent = false;
+		if (c < end && (*c == '-' || *c == '+'))
+		{
+			negativeExponent = *c == '-';
+			c++;
+		}
+		if (c < end && IsDigit(*c))
+		{
+			int value = 0;
+			while (c < end && IsDigit(*c))
+			{
+				if (value < 100000)
+					value = value * 10 + (*c - '0');
+				c++;
+			}
+			exponent += negativeExponent ? -value : value;
+		}
+		else
+		{
+			c = exponentBegin;
+		}
+	}
+
+	// Anything unusual (hex, inf/nan, trailing garbage, too many digits) is left to strtof
+	if (!anyDigit || c != end || digits > 19)
+		return parseFloatFallback(token);
+
+	if (mantissa == 0)
+		return negative ? -0.0f : 0.0f;
+
+	if (mantissa > (1ull << 53) || exponent < -22 || exponent > 22)
+		return parseFloatFallback(token);
+
+	// Both operands are exact doubles, so the result is the correctly rounded double
+	double value = exponent < 0 ? (double)mantissa / POWERS_OF_TEN[-exponent] : (double)mantissa * POWERS_OF_TEN[exponent];
+
+	// Rounding that double to float is only ambiguous if it landed exactly between two floats
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int binaryExponent = (int)((bits >> 52) & 0x7FF) - 1023;
+	if (binaryExponent < -126 || binaryExponent > 127 || (bits & 0x1FFFFFFFull) == 0x10000000ull)
+		return parseFloatFallback(token);
+
+	float result = (float)value;
+	return negative ? -result : result;
+}
+
+//Parses optionally signed integer at the cursor and moves it behind, returns false if there were no digits
+inline bool ParseInt(const char*& cursor, const char* end, int& value)
+{
+	bool negative = false;
+	if (cursor < end && (*cursor == '-' || *cursor == '+'))
+	{
+		negative = *cursor == '-';
+		cursor++;
+	}
+
+	const char* digitsBegin = cursor;
+	int result = 0;
+	while (cursor < end && IsDigit(*cursor))
+	{
+		result = result * 10 + (*cursor - '0');
+		cursor++;
+	}
+
+	value = negative ? -result : result;
+	return cursor != digitsBegin;
+}
+
+//Parses unsigned integer; non plain digit tokens go through float like std::stof based loaders did
+inline unsigned int ParseUInt(const Token& token)
+{
+	const char* c = token.begin;
+	unsigned int value = 0;
+	while (c < token.end && IsDigit(*c))
+	{
+		value = value * 10 + (unsigned int)(*c - '0');
+		c++;
+	}
+
+	if (c == token.end && c != token.begin)
+		return value;
+
+	return (unsigned int)ParseFloat(token);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "utils/Bvh.h"
+
+//Closest scene triangle under a point of a view. Triangles are numbered as in the scene indices,
+//part and material are -1 in scenes without parts.
+struct PickResult
+{
+	bool hit;
+	unsigned int triangle;
+	int part;
+	int material;
+	glm::vec3 position;
+	//Geometric normal of the triangle, facing the ray
+	glm::vec3 normal;
+	float distance;
+
+	PickResult() : hit(false), triangle(BVH_NO_TRIANGLE), part(-1), material(-1), position(0.0f), normal(0.0f), distance(0.0f) {}
+};
+
+//Ray through a point given in normalized device coordinates of a view, from its near to its far plane.
+//Perspective and orthographic projections are handled alike.
+inline BvhRay UnprojectRay(const glm::vec2& ndc, const glm::mat4& inverseViewProjection)
+{
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+	float length = glm::length(direction);
+	return BvhRay(origin, length > 0.0f ? direction / length : glm::vec3(0.0f, 0.0f, -1.0f), length);
+}
+
+inline BvhRay UnprojectRay(const glm::vec2& ndc, const glm::mat4& view, const glm::mat4& projection)
+{
+	return UnprojectRay(ndc, glm::inverse(projection * view));
+}
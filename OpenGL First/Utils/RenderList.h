@@ -0,0 +1,149 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "Utils/Shader.h"
+#include "Utils/RenderStats.h"
+#include "Utils/GLState.h"
+
+//One indexed draw of a render list: the state it needs and its range of the element buffer bound to the VAO
+struct DrawPacket
+{
+	Shader* shader;
+	GLuint vao;
+	//Slot of the material in the materials block
+	unsigned int material;
+	GLenum indexType;
+	GLsizei count;
+	//Byte offset of the first index
+	size_t offset;
+	GLint baseVertex;
+};
+
+//Flat array of draw packets replayed by Execute. Lists are compiled once and kept until what they were built
+//from changes, or filled every frame by culling, in which case the vectors keep their memory.
+class RenderList
+{
+public:
+	void Clear()
+	{
+		packets.clear();
+	}
+
+	//Appends a packet, extending the last one instead when it has the same state and its range continues
+	void Add(const DrawPacket& packet)
+	{
+		if (!packets.empty())
+		{
+			DrawPacket& last = packets.back();
+			if (sameState(last, packet) && last.baseVertex == packet.baseVertex && last.offset + last.count * indexSize(last.indexType) == packet.offset)
+			{
+				last.count += packet.count;
+				return;
+			}
+		}
+		packets.push_back(packet);
+	}
+
+	//Orders packets by program, VAO and material, then by buffer offset, so each state is set once per group
+	void Sort()
+	{
+		std::stable_sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b)
+		{
+			if (a.shader != b.shader)
+				return std::less<Shader*>()(a.shader, b.shader);
+			if (a.vao != b.vao)
+				return a.vao < b.vao;
+			if (a.material != b.material)
+				return a.material < b.material;
+			return a.offset < b.offset;
+		});
+	}
+
+	bool IsEmpty() const
+	{
+		return packets.empty();
+	}
+
+	unsigned int GetPacketsCount() const
+	{
+		return packets.size();
+	}
+
+	//Replays the packets. bindProgram(shader) and bindMaterial(shader, material) are called only when the state
+	//differs from the previous packet, runs of packets with the same state go into one multi-draw. With more than
+	//one instance every range is drawn instanced, there is no instanced multi-draw in core 3.3.
+	template <typename ProgramBinder, typename MaterialBinder>
+	void Execute(ProgramBinder bindProgram, MaterialBinder bindMaterial, GLsizei instances = 1)
+	{
+		const DrawPacket* previous = NULL;
+		for (unsigned int i = 0; i < packets.size(); ++i)
+		{
+			const DrawPacket& packet = packets[i];
+			bool programChanged = previous == NULL || packet.shader != previous->shader;
+			if (programChanged)
+			{
+				bindProgram(packet.shader);
+				RenderStats.stateChanges++;
+			}
+			if (previous == NULL || packet.vao != previous->vao)
+			{
+				GLState.BindVertexArray(packet.vao);
+				RenderStats.stateChanges++;
+			}
+			if (programChanged || packet.material != previous->material)
+			{
+				bindMaterial(packet.shader, packet.material);
+				RenderStats.stateChanges++;
+			}
+			previous = &packet;
+
+			counts.push_back(packet.count);
+			offsets.push_back((const void*)packet.offset);
+			baseVertices.push_back(packet.baseVertex);
+			RenderStats.drawPackets++;
+			if (i + 1 == packets.size() || !sameState(packet, packets[i + 1]))
+				flush(packet.indexType, instances);
+		}
+	}
+
+private:
+	std::vector<DrawPacket> packets;
+	// Ranges of the run of packets waiting for their draw call
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> baseVertices;
+
+	static bool sameState(const DrawPacket& a, const DrawPacket& b)
+	{
+		return a.shader == b.shader && a.vao == b.vao && a.material == b.material && a.indexType == b.indexType;
+	}
+
+	static size_t indexSize(GLenum indexType)
+	{
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
+	void flush(GLenum indexType, GLsizei instances)
+	{
+		if (instances > 1)
+		{
+			for (unsigned int i = 0; i < counts.size(); ++i)
+			{
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, counts[i], indexType, offsets[i], instances, baseVertices[i]);
+				RenderStats.drawCalls++;
+			}
+		}
+		else
+		{
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(), counts.size(), baseVertices.data());
+			RenderStats.drawCalls++;
+		}
+		counts.clear();
+		offsets.clear();
+		baseVertices.clear();
+	}
+};
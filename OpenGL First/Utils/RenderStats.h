@@ -0,0 +1,31 @@
+#pragma once
+
+//Rendering counters of the current frame, reset at the beginning of every frame
+struct RenderStatistics
+{
+	unsigned int drawCalls = 0;
+	//Render list packets replayed and program, vertex array and material switches between them
+	unsigned int drawPackets = 0;
+	unsigned int stateChanges = 0;
+	//Uniform values sent to the driver and values skipped because the program already held them
+	unsigned int uniformUploads = 0;
+	unsigned int skippedUniforms = 0;
+	unsigned int uniformBufferUploads = 0;
+	//Viewports drawn again into their render target and viewports copied from it unchanged
+	unsigned int renderedViewports = 0;
+	unsigned int cachedViewports = 0;
+
+	void BeginFrame()
+	{
+		drawCalls = 0;
+		drawPackets = 0;
+		stateChanges = 0;
+		uniformUploads = 0;
+		skippedUniforms = 0;
+		uniformBufferUploads = 0;
+		renderedViewports = 0;
+		cachedViewports = 0;
+	}
+};
+
+RenderStatistics RenderStats;
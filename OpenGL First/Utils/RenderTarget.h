@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <iostream>
+
+#include "Utils/GLState.h"
+
+//Framebuffer with a color and a depth texture, drawn into off screen and copied into a rectangle of the window.
+//Depth is GL_DEPTH24_STENCIL8, the format of the window framebuffer, so it can be copied along with the color.
+class RenderTarget
+{
+public:
+	~RenderTarget()
+	{
+		dispose();
+	}
+
+	//Creates the textures for the size, returns true when they were created and their content is undefined
+	bool Resize(GLsizei targetWidth, GLsizei targetHeight)
+	{
+		if (targetWidth == width && targetHeight == height)
+			return false;
+
+		dispose();
+		width = targetWidth;
+		height = targetHeight;
+		if (width <= 0 || height <= 0)
+			return true;
+
+		glGenTextures(1, &color_texture);
+		glBindTexture(GL_TEXTURE_2D, color_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		setTextureParameters();
+
+		glGenTextures(1, &depth_texture);
+		glBindTexture(GL_TEXTURE_2D, depth_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		setTextureParameters();
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		GLState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
+		complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "ERROR::FRAMEBUFFER::INCOMPLETE " << width << "x" << height << std::endl;
+		GLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+		return true;
+	}
+
+	//False for an empty size or when the driver rejected the attachments, the target can't be drawn into then
+	bool IsComplete() const
+	{
+		return complete;
+	}
+
+	//Makes the target the destination of drawing, over its whole size
+	void Bind()
+	{
+		GLState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		GLState.Viewport(0, 0, width, height);
+	}
+
+	//Copies color and depth into the window framebuffer with the lower left corner at x, y and leaves it bound
+	void BlitToWindow(GLint x, GLint y)
+	{
+		GLState.BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		GLState.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, width, height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		GLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	GLuint GetColorTexture() const
+	{
+		return color_texture;
+	}
+
+	GLuint GetDepthTexture() const
+	{
+		return depth_texture;
+	}
+
+	unsigned int GetGpuMemoryUsage() const
+	{
+		return complete ? width * height * 8 : 0;
+	}
+
+private:
+	GLuint framebuffer = 0;
+	GLuint color_texture = 0;
+	GLuint depth_texture = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+	bool complete = false;
+
+	static void setTextureParameters()
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	void dispose()
+	{
+		if (framebuffer != 0)
+			GLState.DeleteFramebuffer(framebuffer);
+		glDeleteTextures(1, &color_texture);
+		glDeleteTextures(1, &depth_texture);
+		color_texture = depth_texture = 0;
+		complete = false;
+	}
+};
@@ -2,11 +2,19 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+
+#include "Utils/RenderStats.h"
+#include "Utils/GLState.h"
 
 struct Material {
 	std::string name = "defMat";
@@ -15,6 +23,58 @@ struct Material {
 	float specular = 0.5f;
 };
 
+//FNV-1a hash of a uniform name, evaluated by the compiler for names known at compile time
+constexpr uint32_t HashUniformName(const char* name, uint32_t hash = 2166136261u)
+{
+	return *name == '\0' ? hash : HashUniformName(name + 1, (hash ^ (uint32_t)(unsigned char)*name) * 16777619u);
+}
+
+//Uniform name with its hash. Declared constexpr it costs no hashing at runtime.
+struct UniformName
+{
+	const char* name;
+	uint32_t hash;
+
+	constexpr UniformName(const char* uniformName) : name(uniformName), hash(HashUniformName(uniformName)) {}
+};
+
+//GL types a uniform of C++ type T can be declared as in GLSL
+template <typename T> struct UniformType;
+template <> struct UniformType<float> { static bool Matches(GLenum type) { return type == GL_FLOAT; } };
+template <> struct UniformType<glm::vec2> { static bool Matches(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template <> struct UniformType<glm::vec3> { static bool Matches(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template <> struct UniformType<glm::vec4> { static bool Matches(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template <> struct UniformType<glm::mat2> { static bool Matches(GLenum type) { return type == GL_FLOAT_MAT2; } };
+template <> struct UniformType<glm::mat3> { static bool Matches(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template <> struct UniformType<glm::mat4> { static bool Matches(GLenum type) { return type == GL_FLOAT_MAT4; } };
+template <> struct UniformType<bool> { static bool Matches(GLenum type) { return type == GL_BOOL || type == GL_INT; } };
+template <> struct UniformType<int> { static bool Matches(GLenum type) { return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE; } };
+
+//Active uniform of one shader resolved once, setting it through Shader::Set costs no lookup.
+//Invalid when the uniform is not active in the program or has another type, setting it then does nothing.
+template <typename T>
+struct UniformHandle
+{
+	int index;
+
+	UniformHandle() : index(-1) {}
+	explicit UniformHandle(int uniformIndex) : index(uniformIndex) {}
+
+	bool IsValid() const
+	{
+		return index >= 0;
+	}
+};
+
+constexpr UniformName MODEL_UNIFORM("model");
+constexpr UniformName MATERIAL_COLOR_UNIFORM("mat.color");
+constexpr UniformName MATERIAL_AMBIENT_UNIFORM("mat.ambient");
+constexpr UniformName MATERIAL_SPECULAR_UNIFORM("mat.specular");
+constexpr UniformName MATERIAL_INDEX_UNIFORM("materialIndex");
+constexpr UniformName POSITION_SCALE_UNIFORM("positionScale");
+constexpr UniformName POSITION_OFFSET_UNIFORM("positionOffset");
+constexpr UniformName OCTAHEDRAL_NORMALS_UNIFORM("octahedralNormals");
+
 //Code from LearnOpenGL extended by me
 class Shader
 {
@@ -22,7 +82,8 @@ public:
 	unsigned int ID;
 	// constructor generates the shader on the fly
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath)
+	// defines are inserted after the #version line of both stages, one variant of a file per set of defines
+	Shader(const char* vertexPath, const char* fragmentPath, const char* defines = NULL)
 	{
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
@@ -52,6 +113,11 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
+		if (defines != NULL)
+		{
+			insertDefines(vertexCode, defines);
+			insertDefines(fragmentCode, defines);
+		}
 		const char* vShaderCode = vertexCode.c_str();
 		const char * fShaderCode = fragmentCode.c_str();
 		// 2. compile shaders
@@ -60,107 +126,294 @@ public:
 		vertex = glCreateShader(GL_VERTEX_SHADER);
 		glShaderSource(vertex, 1, &vShaderCode, NULL);
 		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
+		bool compiled = checkCompileErrors(vertex, "VERTEX");
 		// fragment Shader
 		fragment = glCreateShader(GL_FRAGMENT_SHADER);
 		glShaderSource(fragment, 1, &fShaderCode, NULL);
 		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
+		compiled = checkCompileErrors(fragment, "FRAGMENT") && compiled;
 		// shader Program
 		ID = glCreateProgram();
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
 		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
+		linked = checkCompileErrors(ID, "PROGRAM") && compiled;
 		// delete the shaders as they're linked into our program now and no longer necessary
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
+
+		reflectUniforms();
+		modelMatrix = GetUniform<glm::mat4>(MODEL_UNIFORM);
+		materialColor = GetUniform<glm::vec3>(MATERIAL_COLOR_UNIFORM);
+		materialAmbient = GetUniform<float>(MATERIAL_AMBIENT_UNIFORM);
+		materialSpecular = GetUniform<float>(MATERIAL_SPECULAR_UNIFORM);
+		materialIndex = GetUniform<int>(MATERIAL_INDEX_UNIFORM);
+		positionScale = GetUniform<glm::vec3>(POSITION_SCALE_UNIFORM);
+		positionOffset = GetUniform<glm::vec3>(POSITION_OFFSET_UNIFORM);
+		octahedralNormals = GetUniform<bool>(OCTAHEDRAL_NORMALS_UNIFORM);
+	}
+	//False when a stage failed to compile or the program to link, drawing with it shows nothing
+	bool IsLinked() const
+	{
+		return linked;
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use()
 	{
-		glUseProgram(ID);
+		GLState.UseProgram(ID);
+	}
+	//Handle of an active uniform, invalid when the program has no such uniform of type T.
+	//Array uniforms are found by their name with or without [0].
+	template <typename T>
+	UniformHandle<T> GetUniform(const UniformName& name) const
+	{
+		auto found = uniforms_by_hash.find(name.hash);
+		if (found == uniforms_by_hash.end() || !matchesName(uniforms[found->second].name, name.name))
+			return UniformHandle<T>();
+
+		ShaderUniform& uniform = uniforms[found->second];
+		if (!UniformType<T>::Matches(uniform.type))
+		{
+			if (!uniform.typeErrorReported)
+				std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH " << uniform.name << std::endl;
+			uniform.typeErrorReported = true;
+			return UniformHandle<T>();
+		}
+		return UniformHandle<T>(found->second);
+	}
+
+	//Uploads the value unless the uniform already holds it. The program has to be in use.
+	template <typename T>
+	void Set(UniformHandle<T> handle, const T& value) const
+	{
+		if (handle.index < 0)
+			return;
+
+		ShaderUniform& uniform = uniforms[handle.index];
+		if (uniform.valueSet && std::memcmp(uniform.value, &value, sizeof(T)) == 0)
+		{
+			RenderStats.skippedUniforms++;
+			return;
+		}
+		std::memcpy(uniform.value, &value, sizeof(T));
+		uniform.valueSet = true;
+		upload(uniform.location, value);
+		RenderStats.uniformUploads++;
+	}
+
+	//Connects a uniform block of the program to a binding point, false when the program has no such block
+	bool BindUniformBlock(const char* blockName, GLuint binding)
+	{
+		GLuint index = glGetUniformBlockIndex(ID, blockName);
+		if (index == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(ID, index, binding);
+		return true;
+	}
+
+	//Names and GL types of all active uniforms outside uniform blocks
+	unsigned int GetUniformsCount() const
+	{
+		return uniforms.size();
+	}
+
+	const std::string& GetUniformName(unsigned int uniform) const
+	{
+		return uniforms[uniform].name;
 	}
+
+	GLenum GetUniformType(unsigned int uniform) const
+	{
+		return uniforms[uniform].type;
+	}
+
 	// utility uniform functions
 	float getFloat(const std::string &name)
 	{
+		UniformHandle<float> handle = GetUniform<float>(name.c_str());
+		if (!handle.IsValid())
+			return 0.0f;
+
+		const ShaderUniform& uniform = uniforms[handle.index];
+		if (uniform.valueSet)
+			return *(const float*)uniform.value;
 		float result;
-		glGetUniformfv(ID, glGetUniformLocation(ID, name.c_str()), &result);
+		glGetUniformfv(ID, uniform.location, &result);
 		return result;
 	}
-	// utility uniform functions
+	// utility uniform functions, looking the name up in the reflected uniforms instead of asking the driver
 // ------------------------------------------------------------------------
 	void setBool(const std::string &name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		Set(GetUniform<bool>(name.c_str()), value);
 	}
 	// ------------------------------------------------------------------------
 	void setInt(const std::string &name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		Set(GetUniform<int>(name.c_str()), value);
 	}
 	// ------------------------------------------------------------------------
 	void setFloat(const std::string &name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		Set(GetUniform<float>(name.c_str()), value);
 	}
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string &name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		Set(GetUniform<glm::vec2>(name.c_str()), value);
 	}
 	void setVec2(const std::string &name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		setVec2(name, glm::vec2(x, y));
 	}
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string &name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		Set(GetUniform<glm::vec3>(name.c_str()), value);
 	}
 	void setVec3(const std::string &name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		setVec3(name, glm::vec3(x, y, z));
 	}
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string &name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		Set(GetUniform<glm::vec4>(name.c_str()), value);
 	}
 	void setVec4(const std::string &name, float x, float y, float z, float w)
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		setVec4(name, glm::vec4(x, y, z, w));
 	}
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string &name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		Set(GetUniform<glm::mat2>(name.c_str()), mat);
 	}
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string &name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		Set(GetUniform<glm::mat3>(name.c_str()), mat);
 	}
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string &name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		Set(GetUniform<glm::mat4>(name.c_str()), mat);
+	}
+
+	void setModel(const glm::mat4 &model)
+	{
+		Set(modelMatrix, model);
 	}
 
 	void setMaterial(const Material &material)
 	{
-		setVec3("mat.color", material.color);
-		setFloat("mat.ambient", material.ambient);
-		setFloat("mat.specular", material.specular);
+		Set(materialColor, material.color);
+		Set(materialAmbient, material.ambient);
+		Set(materialSpecular, material.specular);
+	}
+
+	//Slot of the material in the bound window of the materials block
+	void setMaterialIndex(int index)
+	{
+		Set(materialIndex, index);
+	}
+
+	//Decoding of the scene vertex format, positions are dequantized as position * scale + offset
+	void setVertexFormat(const glm::vec3 &scale, const glm::vec3 &offset, bool octahedral)
+	{
+		Set(positionScale, scale);
+		Set(positionOffset, offset);
+		Set(octahedralNormals, octahedral);
 	}
 
 private:
+	//Active uniform with the last value uploaded to it, big enough for a mat4
+	struct ShaderUniform
+	{
+		std::string name;
+		GLenum type;
+		GLint location;
+		float value[16];
+		bool valueSet = false;
+		bool typeErrorReported = false;
+	};
+
+	bool linked = false;
+	// Shadow copy of the program state, the const setters keep it in sync with what they upload
+	mutable std::vector<ShaderUniform> uniforms;
+	std::unordered_map<uint32_t, unsigned int> uniforms_by_hash;
+
+	UniformHandle<glm::mat4> modelMatrix;
+	UniformHandle<glm::vec3> materialColor;
+	UniformHandle<float> materialAmbient;
+	UniformHandle<float> materialSpecular;
+	UniformHandle<int> materialIndex;
+	UniformHandle<glm::vec3> positionScale;
+	UniformHandle<glm::vec3> positionOffset;
+	UniformHandle<bool> octahedralNormals;
+
+	//Lists active uniforms once after linking, uniforms in blocks have no location and are left out
+	void reflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			nameBuffer[0] = '\0';
+			glGetActiveUniform(ID, i, nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+
+			ShaderUniform uniform;
+			uniform.name = std::string(nameBuffer.data(), length);
+			uniform.type = type;
+			uniform.location = glGetUniformLocation(ID, uniform.name.c_str());
+			if (uniform.location < 0)
+				continue;
+
+			uniforms.push_back(uniform);
+			addUniformName(uniform.name, uniforms.size() - 1);
+			// Arrays are reported as name[0], they are set through their plain name as well
+			if (isArrayName(uniform.name))
+				addUniformName(uniform.name.substr(0, uniform.name.size() - 3), uniforms.size() - 1);
+		}
+	}
+
+	static bool isArrayName(const std::string& name)
+	{
+		return name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+	}
+
+	static bool matchesName(const std::string& uniformName, const char* name)
+	{
+		return uniformName == name || (isArrayName(uniformName) && uniformName.compare(0, uniformName.size() - 3, name) == 0);
+	}
+
+	void addUniformName(const std::string& name, unsigned int uniform)
+	{
+		if (!uniforms_by_hash.emplace(HashUniformName(name.c_str()), uniform).second)
+			std::cout << "ERROR::SHADER::UNIFORM_NAME_HASH_COLLISION " << name << std::endl;
+	}
+
+	static void upload(GLint location, float value) { glUniform1f(location, value); }
+	static void upload(GLint location, int value) { glUniform1i(location, value); }
+	static void upload(GLint location, bool value) { glUniform1i(location, (int)value); }
+	static void upload(GLint location, const glm::vec2& value) { glUniform2fv(location, 1, &value[0]); }
+	static void upload(GLint location, const glm::vec3& value) { glUniform3fv(location, 1, &value[0]); }
+	static void upload(GLint location, const glm::vec4& value) { glUniform4fv(location, 1, &value[0]); }
+	static void upload(GLint location, const glm::mat2& value) { glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]); }
+	static void upload(GLint location, const glm::mat3& value) { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+	static void upload(GLint location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(unsigned int shader, std::string type)
+	bool checkCompileErrors(unsigned int shader, std::string type)
 	{
-		int success;
+		int success = 0;
 		char infoLog[1024];
 		if (type != "PROGRAM")
 		{
@@ -180,6 +433,18 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
+	}
+
+	// #version has to stay the first line, so defines go right after it
+	static void insertDefines(std::string& code, const char* defines)
+	{
+		size_t version = code.find("#version");
+		size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+		if (lineEnd == std::string::npos)
+			code = std::string(defines) + "\n" + code;
+		else
+			code.insert(lineEnd + 1, std::string(defines) + "\n");
 	}
 };
 #endif
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstring>
+
+#include "Utils/Shader.h"
+#include "Utils/RenderStats.h"
+#include "Utils/GLState.h"
+
+//Binding points of the uniform blocks shared by the scene, light and frustum shaders
+const GLuint VIEW_BLOCK_BINDING = 0;
+const GLuint LIGHT_BLOCK_BINDING = 1;
+const GLuint MATERIAL_BLOCK_BINDING = 2;
+const GLuint VIEWS_BLOCK_BINDING = 3;
+//Viewports one instanced pass draws, the length of the arrays of ViewsBlock in the shaders
+const unsigned int MULTI_VIEW_COUNT = 4;
+//Length of the materials array of MaterialBlock in the shaders, longer tables are bound one window at a time
+const unsigned int MATERIALS_PER_BLOCK = 256;
+
+//std140 layout of ViewBlock, one block per viewport
+struct ViewBlock
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 viewPos;
+	float padding = 0.0f;
+};
+
+//std140 layout of ViewsBlock, used by shaders built with MULTI_VIEW to draw all viewports in one pass
+struct ViewsBlock
+{
+	glm::mat4 viewProjections[MULTI_VIEW_COUNT];
+	//xy center of the viewport in window NDC, zw its size relative to the window
+	glm::vec4 viewportTransforms[MULTI_VIEW_COUNT];
+	//xyz eye every viewport is lit from, the viewPos of its ViewBlock
+	glm::vec4 viewPositions[MULTI_VIEW_COUNT];
+};
+
+//std140 layout of LightBlock, vec3 members are aligned to 16 bytes
+struct LightBlock
+{
+	glm::vec3 position;
+	float padding0 = 0.0f;
+	glm::vec3 color;
+	float padding1 = 0.0f;
+};
+
+//std140 layout of one Material of the MaterialBlock array, array stride is rounded up to 16 bytes
+struct MaterialBlockEntry
+{
+	glm::vec3 color;
+	float ambient;
+	float specular;
+	float padding[3];
+
+	MaterialBlockEntry() : color(1.0f), ambient(0.0f), specular(0.0f), padding() {}
+	MaterialBlockEntry(const Material& material) : color(material.color), ambient(material.ambient), specular(material.specular), padding() {}
+};
+
+static_assert(sizeof(ViewBlock) == 144, "ViewBlock has to match the std140 layout");
+static_assert(sizeof(ViewsBlock) == 384, "ViewsBlock has to match the std140 layout");
+static_assert(sizeof(LightBlock) == 32, "LightBlock has to match the std140 layout");
+static_assert(sizeof(MaterialBlockEntry) == 32, "MaterialBlockEntry has to match the std140 layout");
+
+//Connects the shared blocks a shader declares to their binding points, blocks it doesn't declare are skipped
+inline void BindSharedUniformBlocks(Shader* shader)
+{
+	shader->BindUniformBlock("ViewBlock", VIEW_BLOCK_BINDING);
+	shader->BindUniformBlock("LightBlock", LIGHT_BLOCK_BINDING);
+	shader->BindUniformBlock("MaterialBlock", MATERIAL_BLOCK_BINDING);
+	shader->BindUniformBlock("ViewsBlock", VIEWS_BLOCK_BINDING);
+}
+
+//Uniform buffer with an array of blocks of one size for one binding point. Every block starts at an offset
+//the driver can bind, so switching blocks is a single glBindBufferRange.
+class UniformBuffer
+{
+public:
+	UniformBuffer(GLuint bindingPoint, unsigned int blockSize) : binding(bindingPoint), block_size(blockSize)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment <= 0)
+			alignment = 256;
+		stride = (blockSize + alignment - 1) / alignment * alignment;
+		glGenBuffers(1, &buffer);
+	}
+
+	~UniformBuffer()
+	{
+		GLState.DeleteBuffer(buffer);
+	}
+
+	//Uploads count tightly packed blocks, unless the buffer already holds exactly them. Returns true when uploaded.
+	bool Upload(const void* blocks, unsigned int count)
+	{
+		staging.assign(count * stride, 0);
+		for (unsigned int i = 0; i < count; i++)
+			std::memcpy(staging.data() + i * stride, (const char*)blocks + i * block_size, block_size);
+		if (staging == data)
+			return false;
+
+		GLState.BindBuffer(GL_UNIFORM_BUFFER, buffer);
+		if (staging.size() != data.size())
+		{
+			glBufferData(GL_UNIFORM_BUFFER, staging.size(), staging.data(), GL_DYNAMIC_DRAW);
+		}
+		else
+		{
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+		}
+		data.swap(staging);
+		RenderStats.uniformBufferUploads++;
+		return true;
+	}
+
+	//Makes the block visible to shaders at the binding point, nothing when it already is
+	void Bind(unsigned int block)
+	{
+		GLState.BindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, block * stride, block_size);
+	}
+
+	unsigned int GetBlocksCount() const
+	{
+		return data.size() / stride;
+	}
+
+	unsigned int GetGpuMemoryUsage() const
+	{
+		return data.size();
+	}
+
+private:
+	GLuint buffer = 0;
+	GLuint binding;
+	unsigned int block_size;
+	unsigned int stride;
+	// Copy of the buffer contents, to skip uploads of unchanged blocks
+	std::vector<char> data;
+	std::vector<char> staging;
+};
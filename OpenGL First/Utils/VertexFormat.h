@@ -0,0 +1,126 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//Layouts the scene geometry can be uploaded with
+enum VertexFormat
+{
+	//Positions and normals as float32 in two buffers (24 bytes per vertex)
+	VERTEX_FORMAT_SEPARATE_FLOAT,
+	//Positions and normals as float32 interleaved in one buffer (24 bytes per vertex)
+	VERTEX_FORMAT_INTERLEAVED_FLOAT,
+	//16-bit positions against scene box and GL_INT_2_10_10_10_REV normals (12 bytes per vertex)
+	VERTEX_FORMAT_QUANTIZED_PACKED_NORMALS,
+	//16-bit positions against scene box and octahedral 2x16-bit normals (12 bytes per vertex)
+	VERTEX_FORMAT_QUANTIZED_OCTAHEDRAL_NORMALS,
+	VERTEX_FORMATS_COUNT
+};
+
+const char* const VERTEX_FORMAT_NAMES[VERTEX_FORMATS_COUNT] = {
+	"Separate float",
+	"Interleaved float",
+	"Quantized, 10-bit normals",
+	"Quantized, octahedral normals"
+};
+
+struct FloatVertex
+{
+	float position[3];
+	float normal[3];
+};
+
+//Position as normalized unsigned shorts (w unused), normal packed by the format into 32 bits
+struct QuantizedVertex
+{
+	uint16_t position[4];
+	uint32_t normal;
+};
+
+//Maps [min, max] of every axis onto the full 16-bit range, shader restores position as value * scale + offset
+struct PositionQuantization
+{
+	glm::vec3 offset;
+	glm::vec3 scale;
+
+	PositionQuantization() : offset(0.0f), scale(1.0f) {}
+	PositionQuantization(const glm::vec3& min, const glm::vec3& max) : offset(min), scale(max - min) {}
+
+	uint16_t Quantize(float value, unsigned int axis) const
+	{
+		if (scale[axis] <= 0.0f)
+			return 0;
+		float normalized = glm::clamp((value - offset[axis]) / scale[axis], 0.0f, 1.0f);
+		return (uint16_t)(normalized * 65535.0f + 0.5f);
+	}
+
+	float Dequantize(uint16_t value, unsigned int axis) const
+	{
+		return value / 65535.0f * scale[axis] + offset[axis];
+	}
+};
+
+inline int32_t quantizeSnorm(float value, float maxValue)
+{
+	float scaled = glm::clamp(value, -1.0f, 1.0f) * maxValue;
+	return (int32_t)(scaled >= 0.0f ? scaled + 0.5f : scaled - 0.5f);
+}
+
+//Normal as GL_INT_2_10_10_10_REV, read back as normalized signed xyz
+inline uint32_t PackNormal2101010(const glm::vec3& normal)
+{
+	uint32_t x = (uint32_t)quantizeSnorm(normal.x, 511.0f) & 0x3FF;
+	uint32_t y = (uint32_t)quantizeSnorm(normal.y, 511.0f) & 0x3FF;
+	uint32_t z = (uint32_t)quantizeSnorm(normal.z, 511.0f) & 0x3FF;
+	return x | (y << 10) | (z << 20);
+}
+
+inline glm::vec3 UnpackNormal2101010(uint32_t packed)
+{
+	glm::vec3 normal;
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		int32_t value = (int32_t)((packed >> (i * 10)) & 0x3FF);
+		if (value >= 512)
+			value -= 1024;
+		normal[i] = glm::max(value / 511.0f, -1.0f);
+	}
+	return normal;
+}
+
+//Normal folded onto octahedron and stored as two normalized signed shorts
+inline uint32_t PackNormalOctahedral(const glm::vec3& normal)
+{
+	float sum = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+	glm::vec2 octahedral = sum > 0.0f ? glm::vec2(normal.x, normal.y) / sum : glm::vec2(0.0f);
+	if (normal.z < 0.0f)
+	{
+		glm::vec2 folded((1.0f - glm::abs(octahedral.y)) * (octahedral.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - glm::abs(octahedral.x)) * (octahedral.y >= 0.0f ? 1.0f : -1.0f));
+		octahedral = folded;
+	}
+
+	int16_t values[2] = { (int16_t)quantizeSnorm(octahedral.x, 32767.0f), (int16_t)quantizeSnorm(octahedral.y, 32767.0f) };
+	uint32_t packed;
+	memcpy(&packed, values, sizeof(packed));
+	return packed;
+}
+
+//Same decoding as the vertex shaders do
+inline glm::vec3 UnpackNormalOctahedral(uint32_t packed)
+{
+	int16_t values[2];
+	memcpy(values, &packed, sizeof(values));
+	glm::vec2 octahedral(glm::max(values[0] / 32767.0f, -1.0f), glm::max(values[1] / 32767.0f, -1.0f));
+
+	glm::vec3 normal(octahedral.x, octahedral.y, 1.0f - glm::abs(octahedral.x) - glm::abs(octahedral.y));
+	if (normal.z < 0.0f)
+	{
+		normal.x = (1.0f - glm::abs(octahedral.y)) * (octahedral.x >= 0.0f ? 1.0f : -1.0f);
+		normal.y = (1.0f - glm::abs(octahedral.x)) * (octahedral.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	float length = glm::length(normal);
+	return length > 0.0f ? normal / length : normal;
+}
@@ -11,9 +11,13 @@ int main()
 	loadShaders();
 
 	initCameraFrustumBuffers();
+	initPickBuffers();
+	initViewportTargets();
+	gpuProfiler = new GpuProfiler();
 
 	while (!glfwWindowShouldClose(window))
 	{
+		waitForChanges();
 		updateTime();
 		coreLoop();
 	}
@@ -32,6 +36,9 @@ void initGLFW()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// Depth of cached viewports is copied into the window, so the formats have to match
+	glfwWindowHint(GLFW_DEPTH_BITS, 24);
+	glfwWindowHint(GLFW_STENCIL_BITS, 8);
 }
 
 void initWindow()
@@ -46,10 +53,16 @@ void initWindow()
 	glfwMakeContextCurrent(window);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 	glfwSetScrollCallback(window, scrollCallback);
+	//Set before ImGui installs its callbacks, which call these after their own
+	glfwSetCursorPosCallback(window, cursorCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos)
 {
+	requestFrames();
 	if (firstMouse)
 	{
 		lastX = xpos;
@@ -68,6 +81,7 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos)
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
+	requestFrames();
 	if(camera!=NULL)
 		camera->ProcessMouseScroll(yoffset);
 }
@@ -76,7 +90,30 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
 	WIDTH = width;
 	HEIGHT = height;
-	glViewport(0, 0, width, height);
+	GLState.Viewport(0, 0, width, height);
+	requestFrames();
+}
+
+//Cursor moves change hover picking and ImGui highlights, while the camera isn't rotated by mouseCallback
+void cursorCallback(GLFWwindow* window, double xpos, double ypos)
+{
+	requestFrames();
+}
+
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+	requestFrames();
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	requestFrames();
+}
+
+//Window was uncovered or resized and has to be drawn again
+void windowRefreshCallback(GLFWwindow* window)
+{
+	requestFrames();
 }
 
 void initGLAD()
@@ -89,10 +126,10 @@ void initGLAD()
 
 void configOpenGL()
 {
-	glViewport(0, 0, WIDTH, HEIGHT);
+	GLState.Viewport(0, 0, WIDTH, HEIGHT);
 
 	//Z-BUFFER
-	glEnable(GL_DEPTH_TEST);
+	GLState.SetEnabled(GL_DEPTH_TEST, true);
 }
 
 void initImGUI()
@@ -188,6 +225,142 @@ void drawUI()
 			}
 			ImGui::EndMenu();
 		}
+		if (ImGui::BeginMenu("Statistics"))
+		{
+			ImGui::Text("Frame time: %.2f ms", deltaTime * 1000.0f);
+			ImGui::Checkbox("Idle when nothing changes", &idleRendering);
+			ImGui::Text("Frames drawn: %.1f per second, idle %.0f%% of the time", framesPerSecond, idleFraction * 100.0f);
+			ImGui::Text("Draw calls: %u", RenderStats.drawCalls);
+			ImGui::Text("Draw packets: %u, state changes: %u", RenderStats.drawPackets, RenderStats.stateChanges);
+			ImGui::Text("Uniform uploads: %u (%u skipped)", RenderStats.uniformUploads, RenderStats.skippedUniforms);
+			ImGui::Text("Uniform buffer uploads: %u", RenderStats.uniformBufferUploads);
+			bool countStateCalls = GLState.IsStatisticsEnabled();
+			if (ImGui::Checkbox("Count GL state calls", &countStateCalls))
+				GLState.SetStatisticsEnabled(countStateCalls);
+			if (countStateCalls)
+				ImGui::Text("GL state calls: %u issued, %u elided", GLState.GetStatistics().issued, GLState.GetStatistics().elided);
+			if (scene != NULL)
+			{
+				ImGui::Text(scene->IsLoadedFromCache() ? "Loaded from cache in %.1f ms" : "Parsed in %.1f ms", scene->GetLoadTime());
+				ImGui::Text("Vertices: %u", scene->GetVerticesCount());
+				if (scene->GetObjWeldedCorners() > 0)
+					ImGui::Text("Obj corners welded: %u into %u vertices", scene->GetObjWeldedCorners(), scene->GetVerticesCount());
+				if (scene->GetObjSkippedFaces() > 0)
+					ImGui::Text("Obj invalid faces skipped: %u", scene->GetObjSkippedFaces());
+				ImGui::Text("Triangles: %u", scene->GetTrianglesCount());
+				ImGui::Text("GPU memory: %.1f KB", scene->GetGpuMemoryUsage() / 1024.0f);
+
+				int vertexFormat = scene->GetVertexFormat();
+				if (ImGui::Combo("Vertex format", &vertexFormat, VERTEX_FORMAT_NAMES, VERTEX_FORMATS_COUNT))
+					scene->SetVertexFormat((VertexFormat)vertexFormat);
+				ImGui::Text("Max position error: %.3g of scene size, normal error: %.3f deg", scene->GetRelativePositionError(), scene->GetNormalError());
+
+				const VertexCacheStatistics& cacheStatistics = scene->GetVertexCacheStatistics();
+				ImGui::Text("ACMR: %.3f  ATVR: %.3f", cacheStatistics.acmr, cacheStatistics.atvr);
+				if (scene->GetOptimizeTime() > 0.0)
+				{
+					const VertexCacheStatistics& unoptimized = scene->GetUnoptimizedVertexCacheStatistics();
+					ImGui::Text("Optimized in %.1f ms from ACMR: %.3f  ATVR: %.3f", scene->GetOptimizeTime(), unoptimized.acmr, unoptimized.atvr);
+				}
+				if (ImGui::Checkbox("Optimize mesh (reloads scene)", &optimizeMeshOnLoad))
+					loadScene(true);
+
+				ImGui::Separator();
+				ImGui::Text("Meshlets: %u", scene->GetMeshletsCount());
+				bool frustumCulling = scene->IsFrustumCullingEnabled();
+				if (ImGui::Checkbox("Frustum culling", &frustumCulling))
+					scene->SetFrustumCulling(frustumCulling);
+				bool backfaceCulling = scene->IsBackfaceCullingEnabled();
+				if (ImGui::Checkbox("Backface culling", &backfaceCulling))
+					scene->SetBackfaceCulling(backfaceCulling);
+				bool occlusionCulling = scene->IsOcclusionCullingEnabled();
+				if (ImGui::Checkbox("Occlusion culling", &occlusionCulling))
+					scene->SetOcclusionCulling(occlusionCulling);
+				bool lodEnabled = scene->IsLodEnabled();
+				if (ImGui::Checkbox("Level of detail", &lodEnabled))
+					scene->SetLodEnabled(lodEnabled);
+				ImGui::Text("Levels of detail: %u (%u triangles)", scene->GetLodLevelsCount(), scene->GetLodTrianglesCount());
+				if (scene->GetLodTime() > 0.0)
+				{
+					ImGui::SameLine();
+					ImGui::Text("simplified in %.1f ms", scene->GetLodTime());
+				}
+				float lodPixelError = scene->GetLodPixelError();
+				if (ImGui::SliderFloat("LOD pixel error", &lodPixelError, 0.0f, 16.0f))
+					scene->SetLodPixelError(lodPixelError);
+				ImGui::Checkbox("Cache ortho viewports", &cacheOrthoViewports);
+				ImGui::Text("Ortho viewports: %u drawn, %u cached", RenderStats.renderedViewports, RenderStats.cachedViewports);
+				if (!singlePassSupported)
+					ImGui::Text("Single pass viewports not supported");
+				else
+					ImGui::Checkbox("Single pass viewports (no meshlet culling and LOD)", &singlePassViewports);
+				for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
+				{
+					const CullingStatistics& culling = viewportsCulling[i];
+					ImGui::Text("%s: %u / %u parts, %u / %u meshlets, culled %u frustum + %u backface triangles", VIEWPORT_NAMES[i],
+						culling.visibleParts, culling.parts, culling.visibleMeshlets, culling.meshlets, culling.frustumCulledTriangles, culling.backfaceCulledTriangles);
+					ImGui::Text("    drawn %u / %u triangles, %u parts simplified", culling.drawnTriangles, culling.triangles, culling.lodParts);
+					ImGui::Text("    occluded %u parts (%u triangles) behind %u occluder triangles", culling.occludedParts, culling.occlusionCulledTriangles,
+						culling.occluderTriangles);
+				}
+				ImGui::Text("Occlusion culling time: %.3f ms", scene->GetOcclusionTime());
+
+				ImGui::Separator();
+				if (ImGui::Button("Run BVH benchmark"))
+					bvhBenchmark = RunBvhBenchmark(scene->GetBvh(), scene->GetBoundingSphere());
+				const Bvh& bvh = scene->GetBvh();
+				ImGui::Text("BVH: %u nodes, %.1f MB, built in %.1f ms", bvh.GetNodesCount(), bvh.GetMemoryUsage() / (1024.0f * 1024.0f), bvh.GetBuildTime());
+				if (bvhBenchmark.rays > 0)
+				{
+					ImGui::Text("Closest hit: %.2f Mrays/s  Any hit: %.2f Mrays/s  (%u / %u rays hit)", bvhBenchmark.nearestRaysPerSecond / 1e6,
+						bvhBenchmark.anyRaysPerSecond / 1e6, bvhBenchmark.hits, bvhBenchmark.rays);
+				}
+			}
+			ImGui::EndMenu();
+		}
+		if (ImGui::BeginMenu("Profiler"))
+		{
+			bool profilerEnabled = gpuProfiler->IsEnabled();
+			if (ImGui::Checkbox("GPU timer queries", &profilerEnabled))
+				gpuProfiler->SetEnabled(profilerEnabled);
+			ImGui::Text("%u frames, %u dropped with results not ready", gpuProfiler->GetFramesCount(), gpuProfiler->GetDroppedFramesCount());
+			ImGui::Text("%-12s %8s %8s %8s %8s %8s", "Pass (ms)", "avg", "p50", "p95", "p99", "max");
+			std::vector<GpuPassStatistics> passes = gpuProfiler->GetPassStatistics();
+			for (unsigned int i = 0; i < passes.size(); i++)
+			{
+				const GpuPassStatistics& pass = passes[i];
+				ImGui::Text("%-12s %8.3f %8.3f %8.3f %8.3f %8.3f", pass.name.c_str(), pass.average, pass.median, pass.p95, pass.p99, pass.max);
+			}
+			if (ImGui::Button("Save CSV"))
+				gpuProfiler->WriteCsv(PROFILER_CSV_PATH);
+			ImGui::SameLine();
+			if (ImGui::Button("Reset"))
+				gpuProfiler->Reset();
+			ImGui::EndMenu();
+		}
+		if (scene != NULL && ImGui::BeginMenu("Selection"))
+		{
+			if (selectedPick.hit)
+			{
+				ImGui::Text("Part: %d", selectedPick.part);
+				ImGui::Text("Material: %s", scene->GetMaterialName(selectedPick.material).c_str());
+				ImGui::Text("Triangle: %u", selectedPick.triangle);
+				ImGui::Text("Position: %.4f %.4f %.4f", selectedPick.position.x, selectedPick.position.y, selectedPick.position.z);
+				ImGui::Text("Normal: %.3f %.3f %.3f", selectedPick.normal.x, selectedPick.normal.y, selectedPick.normal.z);
+				if (ImGui::MenuItem("Clear"))
+					selectedPick = PickResult();
+			}
+			else
+			{
+				ImGui::Text("Left click a viewport to select a triangle");
+			}
+			ImGui::EndMenu();
+		}
+		if (hoverPick.hit)
+		{
+			ImGui::Text("Part %d (%s), triangle %u at %.3f %.3f %.3f, picked in %.3f ms", hoverPick.part, scene->GetMaterialName(hoverPick.material).c_str(),
+				hoverPick.triangle, hoverPick.position.x, hoverPick.position.y, hoverPick.position.z, pickTime);
+		}
 	ImGui::EndMainMenuBar();
 
 
@@ -255,20 +428,73 @@ void loadShaders()
 	gouraudShader = new Shader("Shaders/vertexTextureGouraud.vert", "Shaders/fragmentTextureGouraud.frag");
 	sceneShader = gouraudShader;
 	frustumShader = new Shader("Shaders/frustum.vert","Shaders/frustum.frag");
+	BindSharedUniformBlocks(phongShader);
+	BindSharedUniformBlocks(gouraudShader);
+	BindSharedUniformBlocks(frustumShader);
+	viewBuffer = new UniformBuffer(VIEW_BLOCK_BINDING, sizeof(ViewBlock));
+
+	phongMultiViewShader = new Shader("Shaders/vertexTexturePhong.vert", "Shaders/fragmentTexturePhong.frag", "#define MULTI_VIEW");
+	gouraudMultiViewShader = new Shader("Shaders/vertexTextureGouraud.vert", "Shaders/fragmentTextureGouraud.frag", "#define MULTI_VIEW");
+	BindSharedUniformBlocks(phongMultiViewShader);
+	BindSharedUniformBlocks(gouraudMultiViewShader);
+	viewsBuffer = new UniformBuffer(VIEWS_BLOCK_BINDING, sizeof(ViewsBlock));
+	// Every viewport clips its instance with 4 planes, otherwise viewports are drawn one by one
+	GLint clipDistances = 0;
+	glGetIntegerv(GL_MAX_CLIP_DISTANCES, &clipDistances);
+	singlePassSupported = phongMultiViewShader->IsLinked() && gouraudMultiViewShader->IsLinked() && clipDistances >= 4;
 }
 
-void loadScene()
+//Loads filePathName, reloading the same scene keeps the camera, the light and the culling settings as they are
+void loadScene(bool reload)
 {
+	reload = reload && scene != NULL && tppCamera != NULL && light != NULL;
+	VertexFormat vertexFormat = VERTEX_FORMAT_QUANTIZED_PACKED_NORMALS;
+	glm::vec3 previousLightPos, previousLightColor;
+	bool frustumCulling = true, backfaceCulling = true, occlusionCulling = true, lodEnabled = true;
+	float lodPixelError = 0.0f;
 	if (scene != NULL)
+	{
+		vertexFormat = scene->GetVertexFormat();
+		previousLightPos = scene->LightPos;
+		previousLightColor = scene->LightColor;
+		frustumCulling = scene->IsFrustumCullingEnabled();
+		backfaceCulling = scene->IsBackfaceCullingEnabled();
+		occlusionCulling = scene->IsOcclusionCullingEnabled();
+		lodEnabled = scene->IsLodEnabled();
+		lodPixelError = scene->GetLodPixelError();
 		delete scene;
+	}
 
-	if (tppCamera != NULL)
-		delete tppCamera;
-	
-	if (light != NULL)
-		delete light;
+	if (!reload)
+	{
+		if (tppCamera != NULL)
+			delete tppCamera;
 
-	scene = new Scene(filePathName.c_str());
+		if (light != NULL)
+			delete light;
+	}
+
+	scene = new Scene(filePathName.c_str(), vertexFormat, optimizeMeshOnLoad);
+	if (reload)
+	{
+		scene->LightPos = previousLightPos;
+		scene->LightColor = previousLightColor;
+		scene->SetFrustumCulling(frustumCulling);
+		scene->SetBackfaceCulling(backfaceCulling);
+		scene->SetOcclusionCulling(occlusionCulling);
+		scene->SetLodEnabled(lodEnabled);
+		scene->SetLodPixelError(lodPixelError);
+	}
+	bvhBenchmark = BvhBenchmark();
+	viewStates.Invalidate();
+	hoverPick = PickResult();
+	selectedPick = PickResult();
+	hoverPickValid = false;
+	pickUploadedTriangles[0] = pickUploadedTriangles[1] = -1;
+	// Hierarchy for picking is built with the scene, not on the first hovered frame
+	scene->GetBvh();
+	if (reload)
+		return;
 	tppCamera = new TPPcamera(cameraPath.c_str());
 	light = new Light(scene->LightPos, scene->LightColor, LIGHT_SCALE, "Shaders/light.vert", "Shaders/light.frag");
 	camera = tppCamera;
@@ -294,8 +520,29 @@ void dispose()
 	if(frustumShader != NULL)
 		delete frustumShader;
 
+	if (phongMultiViewShader != NULL)
+		delete phongMultiViewShader;
+
+	if (gouraudMultiViewShader != NULL)
+		delete gouraudMultiViewShader;
+
+	if (viewBuffer != NULL)
+		delete viewBuffer;
+
+	if (viewsBuffer != NULL)
+		delete viewsBuffer;
+
 	if (light != NULL)
 		delete light;
+
+	for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
+	{
+		if (cachedViewports[i].target != NULL)
+			delete cachedViewports[i].target;
+	}
+
+	if (gpuProfiler != NULL)
+		delete gpuProfiler;
 }
 
 void initCameraFrustumBuffers()
@@ -319,57 +566,89 @@ void initCameraFrustumBuffers()
 	glGenBuffers(1, &cameraVBO);
 	glGenBuffers(1, &cameraEBO);
 	glGenVertexArrays(1, &cameraVAO);
-	glBindVertexArray(cameraVAO);
+	GLState.BindVertexArray(cameraVAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, cameraVBO);
+	GLState.BindBuffer(GL_ARRAY_BUFFER, cameraVBO);
 	glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), frustumVertices, GL_STREAM_DRAW);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cameraEBO);
+	GLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, cameraEBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, 24 * sizeof(unsigned int), frustumIndices, GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+void initPickBuffers()
+{
+	glGenBuffers(1, &pickVBO);
+	glGenVertexArrays(1, &pickVAO);
+	GLState.BindVertexArray(pickVAO);
+
+	GLState.BindBuffer(GL_ARRAY_BUFFER, pickVBO);
+	glBufferData(GL_ARRAY_BUFFER, 18 * sizeof(float), NULL, GL_STREAM_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
 }
 
-void updateFrustumPoints()
+void initViewportTargets()
 {
-	glm::mat4 model = glm::mat4();
-	glm::mat4 view = camera->GetViewMatrix();
-	glm::mat4 projection = glm::perspective(glm::radians(camera->Zoom), (float)WIDTH / (float)HEIGHT, NEAR_PLANE, FRUSTUM_FAR_PLANE);
-
-	glm::vec4 screenVertices[8];
-	screenVertices[0] = glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
-	screenVertices[1] = glm::vec4(1.0f, 1.0f, -1.0f, 1.0f);
-	screenVertices[2] = glm::vec4(1.0f, -1.0f, -1.0f, 1.0f);
-	screenVertices[3] = glm::vec4(-1.0f, -1.0f, -1.0f, 1.0f);
-	screenVertices[4] = glm::vec4(-1.0f, 1.0f, 1.0f, 1.0f);
-	screenVertices[5] = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-	screenVertices[6] = glm::vec4(1.0f, -1.0f, 1.0f, 1.0f);
-	screenVertices[7] = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);	
-	glm::mat4 invMatrix = glm::inverse(projection * view * model);
-
-	for (unsigned int i = 0; i < 8; i++)
+	for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
 	{
-		screenVertices[i] = (invMatrix * screenVertices[i]);
-		screenVertices[i] /= screenVertices[i].w;
-		for (unsigned int j = i * 3; j < i * 3 + 3; j++)
-		{
-			frustumVertices[j] = screenVertices[i][j % 3];
-		}
+		if (!VIEWPORT_SOURCES[i].perspective)
+			cachedViewports[i].target = new RenderTarget();
 	}
+}
 
-	glBindVertexArray(cameraVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, cameraVBO);
+//Uploads the camera frustum outline when the camera moved
+void updateFrustumPoints()
+{
+	uint64_t version = viewStates.GetViewport(PERSPECTIVE_VIEWPORT).version;
+	if (version == frustumVersion)
+		return;
+	frustumVersion = version;
+
+	const float* vertices = viewStates.GetFrustumVertices();
+	for (unsigned int i = 0; i < 24; i++)
+		frustumVertices[i] = vertices[i];
+
+	GLState.BindBuffer(GL_ARRAY_BUFFER, cameraVBO);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, 24 * sizeof(float), frustumVertices);
+}
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+void requestFrames()
+{
+	pendingFrames = IDLE_SETTLE_FRAMES;
+}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+//Sleeps until an event or a change requests frames, returns at once when idle mode is off or frames are pending.
+//A wait ending without any request draws a single frame, so changes no event reports show up after the timeout.
+void waitForChanges()
+{
+	if (!idleRendering || pendingFrames > 0)
+		return;
+
+	double sleepStart = glfwGetTime();
+	glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+	measuredIdleTime += glfwGetTime() - sleepStart;
+	if (pendingFrames == 0)
+		pendingFrames = 1;
+	//Time asleep doesn't count as frame time, keys held on waking would move the camera by all of it
+	lastFrame = glfwGetTime();
+}
+
+void updateIdleStatistics()
+{
+	measuredFrames++;
+	double now = glfwGetTime();
+	double elapsed = now - measureStart;
+	if (elapsed < 1.0)
+		return;
+	framesPerSecond = measuredFrames / elapsed;
+	idleFraction = measuredIdleTime / elapsed;
+	measuredFrames = 0;
+	measuredIdleTime = 0.0;
+	measureStart = now;
 }
 
 void updateTime()
@@ -381,6 +660,13 @@ void updateTime()
 
 void coreLoop()
 {
+	RenderStats.BeginFrame();
+	GLState.BeginFrame();
+	gpuProfiler->BeginFrame();
+	updateIdleStatistics();
+	//Anything below may request more frames, input arriving with the events polled at the end as well
+	if (pendingFrames > 0)
+		pendingFrames--;
 	processInput(window);
 
 	//rendering
@@ -391,32 +677,57 @@ void coreLoop()
 
 	if (scene != NULL)
 	{
+		// Every viewport takes a quarter of the window
+		if (viewStates.Update(*camera, *scene, (float)WIDTH / (float)HEIGHT, HEIGHT * 0.5f))
+			requestFrames();
+		updateViewBlocks();
+		light->UpdateBlock();
+		scene->UpdateMaterials();
 		updateFrustumPoints();
+		cullViewports();
+		updatePicking();
 
-		glm::mat4 frustum_model = glm::mat4();
+		// Cached ortho viewports are redrawn into their targets first, the window gets the scene only for the rest
+		uint8_t windowViews = updateCachedViewports();
+
+		// The single pass draws only the scene, light and overlays still go viewport by viewport
+		bool singlePass = singlePassViewports && singlePassSupported;
+		if (singlePass)
+		{
+			gpuProfiler->Begin("Single pass");
+			drawViewsSinglePass(windowViews);
+			gpuProfiler->End();
+		}
 
 		//left top
-		glViewport(0, HEIGHT*0.5, WIDTH*0.5, HEIGHT*0.5);
-		drawPerspectiveView();
+		GLState.Viewport(0, HEIGHT*0.5, WIDTH*0.5, HEIGHT*0.5);
+		gpuProfiler->Begin(VIEWPORT_NAMES[PERSPECTIVE_VIEWPORT]);
+		drawPerspectiveView(!singlePass);
+		gpuProfiler->End();
+		gpuProfiler->Begin("Overlays");
+		drawPickHighlight();
+		gpuProfiler->End();
 
 		//left bottom
-		glViewport(0, 0, WIDTH*0.5, HEIGHT*0.5);
-		drawOrtho(Scene::TOP);
-		drawFrustum(frustum_model, scene->GetOrthoView(Scene::TOP), scene->GetOrthoProjection(RATIO, Scene::TOP));
+		drawOrthoViewport(TOP_VIEWPORT, 0, 0, !(windowViews & (1 << TOP_VIEWPORT)), !singlePass);
 
 		//right bottom
-		glViewport(WIDTH*0.5, 0, WIDTH*0.5, HEIGHT*0.5);
-		drawOrtho(Scene::FRONT);
-		drawFrustum(frustum_model, scene->GetOrthoView(Scene::FRONT), scene->GetOrthoProjection(RATIO, Scene::FRONT));
+		drawOrthoViewport(FRONT_VIEWPORT, WIDTH*0.5, 0, !(windowViews & (1 << FRONT_VIEWPORT)), !singlePass);
 
 		//right top
-		glViewport(WIDTH*0.5, HEIGHT*0.5, WIDTH*0.5, HEIGHT*0.5);
-		drawOrtho(Scene::RIGHT);
-		drawFrustum(frustum_model, scene->GetOrthoView(Scene::RIGHT), scene->GetOrthoProjection(RATIO, Scene::RIGHT));
+		drawOrthoViewport(RIGHT_VIEWPORT, WIDTH*0.5, HEIGHT*0.5, !(windowViews & (1 << RIGHT_VIEWPORT)), !singlePass);
 	}
 
-	glViewport(0, 0, WIDTH, HEIGHT); //restore default
+	GLState.Viewport(0, 0, WIDTH, HEIGHT); //restore default
+	gpuProfiler->Begin("UI");
 	drawUI();
+	gpuProfiler->End();
+	gpuProfiler->EndFrame();
+	// ImGui sets program, buffers, viewport and capabilities on its own
+	GLState.Invalidate();
+	//Dragged sliders and edited text change things without new events
+	if (ImGui::IsAnyItemActive())
+		requestFrames();
 
 	//check and call events and swap buffers
 	glfwPollEvents();
@@ -438,9 +749,10 @@ void processInput(GLFWwindow* window)
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		camera->ProcessKeyboard(RIGHT, deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		polygonMode = GL_LINE;
 	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		polygonMode = GL_FILL;
+	GLState.PolygonMode(polygonMode);
 
 	if (lastRmbState == GLFW_RELEASE && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
 	{
@@ -452,7 +764,7 @@ void processInput(GLFWwindow* window)
 	else if(lastRmbState == GLFW_PRESS && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_RELEASE)
 	{
 		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-		glfwSetCursorPosCallback(window, NULL);
+		glfwSetCursorPosCallback(window, cursorCallback);
 		lastRmbState = GLFW_RELEASE;
 	}
 
@@ -465,42 +777,297 @@ void processInput(GLFWwindow* window)
 	
 }
 
-void drawFrustum(glm::mat4 model, glm::mat4 view, glm::mat4 projection)
+void drawFrustum(glm::mat4 model, unsigned int viewport)
 {
+	viewBuffer->Bind(viewport);
 	frustumShader->use();
-	frustumShader->setMat4("model", model);
-	frustumShader->setMat4("view", view);
-	frustumShader->setMat4("projection", projection);
-	glBindVertexArray(cameraVAO);
+	frustumShader->setModel(model);
+	GLState.BindVertexArray(cameraVAO);
 	glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	RenderStats.drawCalls++;
+}
+
+//Viewport under the cursor and the cursor position in its normalized device coordinates
+bool getCursorViewport(unsigned int& viewport, glm::vec2& ndc)
+{
+	double x, y;
+	int windowWidth, windowHeight;
+	glfwGetCursorPos(window, &x, &y);
+	glfwGetWindowSize(window, &windowWidth, &windowHeight);
+	if (windowWidth <= 0 || windowHeight <= 0 || x < 0.0 || y < 0.0 || x >= windowWidth || y >= windowHeight)
+		return false;
+
+	// Window y goes down, viewports are the window quarters laid out as in coreLoop
+	float u = (float)(x / windowWidth) * 2.0f;
+	float v = (1.0f - (float)(y / windowHeight)) * 2.0f;
+	bool right = u >= 1.0f;
+	bool top = v >= 1.0f;
+	viewport = top ? (right ? RIGHT_VIEWPORT : PERSPECTIVE_VIEWPORT) : (right ? FRONT_VIEWPORT : TOP_VIEWPORT);
+	ndc = glm::vec2((u - (right ? 1.0f : 0.0f)) * 2.0f - 1.0f, (v - (top ? 1.0f : 0.0f)) * 2.0f - 1.0f);
+	return true;
+}
+
+//Picks the triangle under the cursor every frame, left click selects it
+void updatePicking()
+{
+	bool cursorFree = lastRmbState == GLFW_RELEASE && !ImGui::GetIO().WantCaptureMouse;
+	unsigned int viewport;
+	glm::vec2 ndc;
+	if (cursorFree && getCursorViewport(viewport, ndc))
+	{
+		uint64_t viewVersion = viewStates.GetViewport(viewport).version;
+		if (!hoverPickValid || viewport != hoverPickViewport || ndc.x != hoverPickNdc.x || ndc.y != hoverPickNdc.y ||
+			viewVersion != hoverPickViewVersion)
+		{
+			auto pickStart = std::chrono::high_resolution_clock::now();
+			hoverPick = scene->Pick(UnprojectRay(ndc, viewStates.GetViewport(viewport).inverseViewProjection));
+			pickTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pickStart).count();
+			hoverPickValid = true;
+			hoverPickViewport = viewport;
+			hoverPickNdc = ndc;
+			hoverPickViewVersion = viewVersion;
+		}
+	}
+	else
+	{
+		hoverPick = PickResult();
+		hoverPickValid = false;
+	}
+
+	unsigned int lmbState = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
+	if (lastLmbState == GLFW_RELEASE && lmbState == GLFW_PRESS && cursorFree)
+		selectedPick = hoverPick;
+	lastLmbState = lmbState;
+
+	// Outlines are uploaded again only when the hovered or the selected triangle changed
+	const PickResult* picks[2] = { &hoverPick, &selectedPick };
+	bool picksChanged = false;
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		int triangle = picks[i]->hit ? (int)picks[i]->triangle : -1;
+		picksChanged = picksChanged || triangle != pickUploadedTriangles[i];
+		pickUploadedTriangles[i] = triangle;
+	}
+	if (!picksChanged)
+		return;
+
+	pickTrianglesCount = 0;
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		if (!picks[i]->hit)
+			continue;
+		glm::vec3 positions[3];
+		scene->GetTrianglePositions(picks[i]->triangle, positions);
+		for (unsigned int k = 0; k < 9; k++)
+			pickVertices[pickTrianglesCount * 9 + k] = positions[k / 3][k % 3];
+		pickTrianglesCount++;
+	}
+	if (pickTrianglesCount == 0)
+		return;
+
+	GLState.BindBuffer(GL_ARRAY_BUFFER, pickVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, pickTrianglesCount * 9 * sizeof(float), pickVertices);
+}
+
+//Outlines picked triangles on top of the scene, with the view block of the current viewport
+void drawPickHighlight()
+{
+	if (pickTrianglesCount == 0)
+		return;
+
+	frustumShader->use();
+	frustumShader->setModel(glm::mat4());
+	GLState.SetEnabled(GL_DEPTH_TEST, false);
+	GLState.BindVertexArray(pickVAO);
+	for (unsigned int i = 0; i < pickTrianglesCount; i++)
+	{
+		glDrawArrays(GL_LINE_LOOP, i * 3, 3);
+		RenderStats.drawCalls++;
+	}
+	GLState.SetEnabled(GL_DEPTH_TEST, true);
+}
+
+//Culls scene parts against all viewports in one pass before any of them is drawn, unless no viewport changed
+void cullViewports()
+{
+	scene->CullParts(viewStates.GetCullingViews(), VIEWPORTS_COUNT, viewStates.GetVersion());
+}
+
+//Eye the viewport is lit from
+glm::vec3 getViewPosition(unsigned int viewport)
+{
+	if (VIEWPORT_SOURCES[viewport].perspective)
+		return tppCamera->Position;
+
+	// Ortho views are lit from their own eye outside the scene, so moving the camera leaves them unchanged
+	const glm::mat4& view = viewStates.GetViewport(viewport).view;
+	const BoundingSphere& sphere = scene->GetBoundingSphere();
+	glm::vec3 eyeDirection = glm::normalize(glm::vec3(glm::inverse(view)[3]));
+	return sphere.center + eyeDirection * (glm::max(sphere.radius, 1.0f) * ORTHO_EYE_DISTANCE);
+}
+
+//Uploads the view blocks of all viewports, nothing when none of them changed
+void updateViewBlocks()
+{
+	ViewBlock blocks[VIEWPORTS_COUNT];
+	for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
+	{
+		blocks[i].view = viewStates.GetViewport(i).view;
+		blocks[i].projection = viewStates.GetViewport(i).projection;
+		blocks[i].viewPos = getViewPosition(i);
+	}
+	viewBuffer->Upload(blocks, VIEWPORTS_COUNT);
+}
+
+//Draws the scene into the viewports selected by the bits of viewsMask with one instanced submission,
+//each instance clipped to its quarter of the window
+void drawViewsSinglePass(uint8_t viewsMask)
+{
+	// Instances go to the selected viewports in order, so the views block lists only them
+	ViewsBlock views;
+	unsigned int instance = 0;
+	for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
+	{
+		if (!(viewsMask & (1 << i)))
+			continue;
+		views.viewProjections[instance] = viewStates.GetViewport(i).viewProjection;
+		views.viewportTransforms[instance] = glm::vec4(VIEWPORT_CENTERS[i].x, VIEWPORT_CENTERS[i].y, 0.5f, 0.5f);
+		views.viewPositions[instance] = glm::vec4(getViewPosition(i), 1.0f);
+		instance++;
+	}
+	viewsBuffer->Upload(&views, 1);
+
+	Shader* shader = sceneShader == phongShader ? phongMultiViewShader : gouraudMultiViewShader;
+	GLState.Viewport(0, 0, WIDTH, HEIGHT);
+	//Every instance is lit from the eye of its viewport in the views block, the view block only fills the declared interface
+	viewBuffer->Bind(PERSPECTIVE_VIEWPORT);
+	viewsBuffer->Bind(0);
+	shader->use();
+	shader->setModel(glm::mat4());
+	for (unsigned int i = 0; i < 4; i++)
+		GLState.SetEnabled(GL_CLIP_DISTANCE0 + i, true);
+	scene->DrawViews(shader, viewsMask);
+	for (unsigned int i = 0; i < 4; i++)
+		GLState.SetEnabled(GL_CLIP_DISTANCE0 + i, false);
+
+	for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
+	{
+		if (viewsMask & (1 << i))
+			viewportsCulling[i] = scene->GetCullingStatistics();
+	}
 }
 
-void drawPerspectiveView()
+void drawPerspectiveView(bool drawScene)
 {
 	glm::mat4 model = glm::mat4();
-	glm::mat4 view = camera->GetViewMatrix();
-	glm::mat4 projection = PerspectiveMatrix(glm::radians(camera->Zoom), (float)WIDTH / (float)HEIGHT, NEAR_PLANE, FAR_PLANE);
-	sceneShader->use();
-	sceneShader->setMat4("model", model);
-	sceneShader->setMat4("view", view);
-	sceneShader->setMat4("projection", projection);
-	sceneShader->setVec3("viewPos", tppCamera->Position);
-	scene->Draw(sceneShader);
-	light->Draw(view, projection);
+	const glm::mat4& view = viewStates.GetViewport(PERSPECTIVE_VIEWPORT).view;
+	const glm::mat4& projection = viewStates.GetViewport(PERSPECTIVE_VIEWPORT).projection;
+	viewBuffer->Bind(PERSPECTIVE_VIEWPORT);
+	if (drawScene)
+	{
+		sceneShader->use();
+		sceneShader->setModel(model);
+		scene->Draw(sceneShader, view, projection, PERSPECTIVE_VIEWPORT);
+		viewportsCulling[PERSPECTIVE_VIEWPORT] = scene->GetCullingStatistics();
+	}
+	drawLight();
+}
+
+//Light model, timed as a pass of its own inside the viewport pass
+void drawLight()
+{
+	gpuProfiler->Begin("Light");
+	light->Draw();
+	gpuProfiler->End();
 }
 
-void drawOrtho(Scene::Side side)
+void drawOrtho(unsigned int viewport, bool drawScene)
 {
 	glm::mat4 model = glm::mat4();
-	glm::mat4 view = scene->GetOrthoView(side);
-	glm::mat4 projection = scene->GetOrthoProjection(RATIO, side);
-	sceneShader->use();
-	sceneShader->setMat4("model", model);
-	sceneShader->setMat4("view", view);
-	sceneShader->setMat4("projection", projection);
-	sceneShader->setVec3("viewPos", tppCamera->Position);
-	scene->Draw(sceneShader);
-	light->Draw(view, projection);
+	const glm::mat4& view = viewStates.GetViewport(viewport).view;
+	const glm::mat4& projection = viewStates.GetViewport(viewport).projection;
+	viewBuffer->Bind(viewport);
+	if (drawScene)
+	{
+		sceneShader->use();
+		sceneShader->setModel(model);
+		scene->Draw(sceneShader, view, projection, viewport);
+		viewportsCulling[viewport] = scene->GetCullingStatistics();
+	}
+	drawLight();
+}
+
+//Draws the viewport of the target again when its content changed, false when the target can't be used
+bool updateCachedViewport(unsigned int viewport, GLsizei width, GLsizei height)
+{
+	CachedViewport& cached = cachedViewports[viewport];
+	ViewportContent content;
+	content.viewVersion = viewStates.GetViewport(viewport).version;
+	content.lightVersion = light->version;
+	content.sceneVersion = scene->GetContentVersion();
+	content.shader = sceneShader;
+	content.polygonMode = polygonMode;
+
+	bool resized = cached.target->Resize(width, height);
+	if (!cached.target->IsComplete())
+		return false;
+	if (!resized && content == cached.content)
+	{
+		RenderStats.cachedViewports++;
+		return true;
+	}
+
+	cached.target->Bind();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawOrtho(viewport);
+	cached.content = content;
+	RenderStats.renderedViewports++;
+	return true;
+}
+
+//Redraws the render targets of cached ortho viewports whose content changed and leaves the window bound.
+//Returns the mask of viewports drawn into the window instead: the perspective one and ortho ones without a usable target.
+uint8_t updateCachedViewports()
+{
+	uint8_t windowViews = 0;
+	for (unsigned int i = 0; i < VIEWPORTS_COUNT; i++)
+	{
+		bool cached = false;
+		if (cacheOrthoViewports && !VIEWPORT_SOURCES[i].perspective)
+		{
+			gpuProfiler->Begin(VIEWPORT_NAMES[i]);
+			cached = updateCachedViewport(i, WIDTH * 0.5, HEIGHT * 0.5);
+			gpuProfiler->End();
+		}
+		if (!cached)
+			windowViews |= 1 << i;
+	}
+	GLState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	return windowViews;
+}
+
+//Ortho viewport with its lower left corner at x, y, copied from its render target when cached, with overlays on top
+void drawOrthoViewport(unsigned int viewport, GLint x, GLint y, bool cached, bool drawScene)
+{
+	GLsizei width = WIDTH * 0.5;
+	GLsizei height = HEIGHT * 0.5;
+	gpuProfiler->Begin(VIEWPORT_NAMES[viewport]);
+	if (cached)
+	{
+		cachedViewports[viewport].target->BlitToWindow(x, y);
+		GLState.Viewport(x, y, width, height);
+		viewBuffer->Bind(viewport);
+	}
+	else
+	{
+		GLState.Viewport(x, y, width, height);
+		drawOrtho(viewport, drawScene);
+	}
+	gpuProfiler->End();
+
+	gpuProfiler->Begin("Overlays");
+	drawPickHighlight();
+	drawFrustum(glm::mat4(), viewport);
+	gpuProfiler->End();
 }
 
@@ -9,11 +9,16 @@
 
 #include "Utils/Shader.h"
 #include "Utils/MatrixUtils.h"
+#include "Utils/RenderStats.h"
+#include "Utils/UniformBuffer.h"
+#include "Utils/RenderTarget.h"
+#include "Utils/GpuProfiler.h"
 
 #include "Scene/Scene.h"
 #include "Scene/Light.h"
 #include "Scene/TPPcamera.h"
 #include "Scene/FPScamera.h"
+#include "Scene/ViewStateCache.h"
 
 #include "Imgui/imgui.h"
 #include "Imgui/imgui_impl_glfw.h"
@@ -41,39 +46,88 @@ void initImGUI();
 void drawUI();
 void drawFileChooser();
 void loadShaders();
-void loadScene();
+void loadScene(bool reload = false);
 void dispose();
 void initCameraFrustumBuffers();
 void updateFrustumPoints();
+void initPickBuffers();
+void initViewportTargets();
 
 //Core loop
 void coreLoop();
+void requestFrames();
+void waitForChanges();
 void updateTime();
+void updateIdleStatistics();
 void processInput(GLFWwindow* window);
-void drawPerspectiveView();
-void drawOrtho(Scene::Side side);
-void drawFrustum(glm::mat4 model, glm::mat4 view, glm::mat4 projection);
+void cullViewports();
+bool getCursorViewport(unsigned int& viewport, glm::vec2& ndc);
+void updatePicking();
+glm::vec3 getViewPosition(unsigned int viewport);
+void updateViewBlocks();
+void drawPickHighlight();
+void drawViewsSinglePass(uint8_t viewsMask);
+void drawPerspectiveView(bool drawScene = true);
+void drawOrtho(unsigned int viewport, bool drawScene = true);
+void drawLight();
+bool updateCachedViewport(unsigned int viewport, GLsizei width, GLsizei height);
+uint8_t updateCachedViewports();
+void drawOrthoViewport(unsigned int viewport, GLint x, GLint y, bool cached, bool drawScene = true);
+void drawFrustum(glm::mat4 model, unsigned int viewport);
 
 //Callbacks and listeners
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+void cursorCallback(GLFWwindow* window, double xpos, double ypos);
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void windowRefreshCallback(GLFWwindow* window);
 
 //Mouse callback variables
 bool firstMouse = true;
 float lastX = WIDTH / 2.0f;
 float lastY = HEIGHT / 2.0f;
 unsigned int lastRmbState = GLFW_RELEASE;
+unsigned int lastLmbState = GLFW_RELEASE;
+
+//GPU time of the passes of coreLoop, off until enabled in the Profiler menu
+GpuProfiler* gpuProfiler;
+const char* const PROFILER_CSV_PATH = "gpu_profile.csv";
 
 //Time variables
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+//Idle mode: frames are drawn only after input or changes, otherwise the loop sleeps in glfwWaitEventsTimeout
+bool idleRendering = true;
+//Frames drawn after the last change. ImGui handles input a frame late and widgets react over a few frames.
+const unsigned int IDLE_SETTLE_FRAMES = 3;
+unsigned int pendingFrames = IDLE_SETTLE_FRAMES;
+//Longest sleep without events, in seconds. A frame is drawn when it runs out, in case a change came without any event.
+const double IDLE_WAIT_TIMEOUT = 1.0;
+//Frames drawn per second and share of the time spent asleep, measured over about a second
+float framesPerSecond = 0.0f;
+float idleFraction = 0.0f;
+unsigned int measuredFrames = 0;
+double measuredIdleTime = 0.0;
+double measureStart = 0.0;
+
 //Dynamic objects
 Shader* sceneShader;
 Shader* phongShader;
 Shader* gouraudShader;
 Shader* frustumShader;
+//Scene shaders drawing all viewports in one instanced pass
+Shader* phongMultiViewShader;
+Shader* gouraudMultiViewShader;
+//View blocks of all viewports, drawing a viewport binds its range
+UniformBuffer* viewBuffer;
+//Matrices and placement of all viewports for the multi view shaders
+UniformBuffer* viewsBuffer;
+//Draw the scene into all viewports not kept in render targets with one submission, when the multi view shaders work on this driver
+bool singlePassViewports = false;
+bool singlePassSupported = false;
 Scene* scene;
 Light* light;
 
@@ -83,6 +137,13 @@ unsigned int cameraVAO;
 unsigned int cameraVBO;
 unsigned int cameraEBO;
 float frustumVertices[24];
+unsigned int pickVAO;
+unsigned int pickVBO;
+//Outlines of the hovered and the selected triangle
+float pickVertices[18];
+unsigned int pickTrianglesCount = 0;
+//Set with P and L keys, ImGui draws filled and puts it back
+GLenum polygonMode = GL_FILL;
 
 //Camera parameters
 float cameraCenter[3];
@@ -93,6 +154,70 @@ std::string fileName = "";
 std::string cameraPath = "";
 std::string filter = "";
 bool openSceneFileDialog = false;
+//Reorder scene triangles and vertices for vertex cache and overdraw when loading
+bool optimizeMeshOnLoad = false;
+
+//Views drawn every frame, parts are culled for all of them at once and culling statistics are kept for each
+enum Viewport
+{
+	PERSPECTIVE_VIEWPORT,
+	TOP_VIEWPORT,
+	FRONT_VIEWPORT,
+	RIGHT_VIEWPORT,
+	VIEWPORTS_COUNT
+};
+const char* const VIEWPORT_NAMES[VIEWPORTS_COUNT] = { "Perspective", "Top", "Front", "Right" };
+//Centers of the viewports in window normalized device coordinates, each one takes a quarter of the window
+const glm::vec2 VIEWPORT_CENTERS[VIEWPORTS_COUNT] = { glm::vec2(-0.5f, 0.5f), glm::vec2(-0.5f, -0.5f), glm::vec2(0.5f, -0.5f), glm::vec2(0.5f, 0.5f) };
+const ViewportSource VIEWPORT_SOURCES[VIEWPORTS_COUNT] = { { true, Scene::FRONT }, { false, Scene::TOP }, { false, Scene::FRONT }, { false, Scene::RIGHT } };
+//Ortho views are lit from an eye this many bounding sphere radii from the scene center, so view rays are nearly parallel
+const float ORTHO_EYE_DISTANCE = 10.0f;
+//Matrices of all viewports, recomputed only when the camera, window or scene change
+ViewStateCache viewStates(VIEWPORT_SOURCES, VIEWPORTS_COUNT, RATIO);
+//Version of the perspective viewport the camera frustum outline was uploaded for
+uint64_t frustumVersion = 0;
+
+//What an ortho viewport was last drawn into its render target with, it is drawn again when any of it changes
+struct ViewportContent
+{
+	uint64_t viewVersion = 0;
+	uint64_t lightVersion = 0;
+	uint64_t sceneVersion = 0;
+	Shader* shader = NULL;
+	GLenum polygonMode = GL_FILL;
+
+	bool operator==(const ViewportContent& other) const
+	{
+		return viewVersion == other.viewVersion && lightVersion == other.lightVersion && sceneVersion == other.sceneVersion &&
+			shader == other.shader && polygonMode == other.polygonMode;
+	}
+};
+
+struct CachedViewport
+{
+	RenderTarget* target = NULL;
+	ViewportContent content;
+};
+
+//Ortho views don't move with the camera, so their scene and light are kept in render targets and copied into
+//the window every frame. Only overlays following the camera or the cursor are drawn over them.
+bool cacheOrthoViewports = true;
+//Indexed by viewport, the perspective one has no target
+CachedViewport cachedViewports[VIEWPORTS_COUNT];
+CullingStatistics viewportsCulling[VIEWPORTS_COUNT];
+//Result of the last BVH benchmark, rays == 0 until one is run
+BvhBenchmark bvhBenchmark;
+//Triangle under the cursor in any viewport and the one last clicked
+PickResult hoverPick;
+PickResult selectedPick;
+double pickTime = 0.0;
+//Cursor and view the hover pick was cast for, the ray is cast again only when one of them changes
+bool hoverPickValid = false;
+unsigned int hoverPickViewport = 0;
+glm::vec2 hoverPickNdc;
+uint64_t hoverPickViewVersion = 0;
+//Triangles in pickVBO, hovered then selected, -1 for none
+int pickUploadedTriangles[2] = { -1, -1 };
 
 //Light parameters
 float lightPos[3];